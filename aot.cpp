@@ -0,0 +1,111 @@
+#include "aot.h"
+
+CpuAot::CpuAot(Cpu65C02& cpu) : m_cpu(cpu), m_blockIndex(65536, -1),
+    m_status(aotBlockCount, BLOCK_UNKNOWN), m_pageBlocks(256), m_abort(0)
+{
+    for (size_t i = 0; i < aotBlockCount; ++i)
+    {
+        const t_block& block = aotBlocks[i];
+        m_blockIndex[block.pc] = i;
+        for (unsigned page = block.pc >> 8; page <= (unsigned) (block.pc + block.size - 1) >> 8; ++page)
+            m_pageBlocks[page & 0xFF].push_back(i);
+    }
+    m_cpu.setCodeObserver(this);
+} // CpuAot
+
+CpuAot::~CpuAot()
+{
+    m_cpu.setCodeObserver(0);
+} // ~CpuAot
+
+// Check that the memory still holds the bytes the block was compiled from.
+// If so, the instructions are decoded by the CPU, which has the memory tell
+// us when any of their bytes are written.
+bool CpuAot::verify(int32_t index)
+{
+    const t_block& block = aotBlocks[index];
+    for (uint16_t i = 0; i < block.size; ++i)
+    {
+        uint16_t addr = block.pc + i;
+        if (m_cpu.m_memory.peek(addr) != aotImage[addr]) {
+            m_status[index] = BLOCK_CHANGED;
+            return false;
+        }
+    }
+
+    for (uint16_t addr = block.pc; addr != (uint16_t) (block.pc + block.size); addr += m_cpu.decode(addr).length)
+        ;
+    m_status[index] = BLOCK_VALID;
+    return true;
+} // verify
+
+// Something has been written to a page with compiled code. The blocks on it
+// are checked again before they are used next time.
+void CpuAot::invalidate(uint16_t addr)
+{
+    for (int32_t index : m_pageBlocks[addr >> 8])
+    {
+        const t_block& block = aotBlocks[index];
+        if ((uint16_t) (addr - block.pc) < block.size) {
+            m_status[index] = BLOCK_UNKNOWN;
+            m_abort = 1;
+        }
+    }
+} // invalidate
+
+Cpu65C02::t_stopReason CpuAot::run(uint64_t budget, uint32_t stopMask)
+{
+    // Breakpoints, watchpoints, profiling and coverage are only handled by
+    // the interpreter. So are the variants other than the 65C02, which
+    // romcc compiles for.
+    bool useAot = m_cpu.m_variant == Cpu65C02::CPU_65C02 && !m_cpu.m_profiler && !m_cpu.m_coverage &&
+                  !(m_cpu.m_breakpointCount && (stopMask & Cpu65C02::STOP_BREAKPOINT)) &&
+                  !(m_cpu.m_memory.watchpointCount() && (stopMask & Cpu65C02::STOP_WATCHPOINT));
+
+    while (useAot)
+    {
+        // Events, interrupts, WAI and code that has not been compiled are
+        // handled by the interpreter, one instruction at a time.
+        int32_t index = m_blockIndex[m_cpu.m_pc];
+        if (index < 0 || m_cpu.m_cycles + aotBlocks[index].cycles >= m_cpu.m_scheduler.next() || m_cpu.m_waiting ||
+            m_status[index] == BLOCK_CHANGED || (m_status[index] == BLOCK_UNKNOWN && !verify(index))) {
+            if (budget == 0)
+                break;
+            uint64_t before = m_cpu.m_instCounter;
+            Cpu65C02::t_stopReason reason = m_cpu.run(1, stopMask);
+            budget -= m_cpu.m_instCounter - before;
+            if (reason != Cpu65C02::STOP_BUDGET)
+                return reason;
+            continue;
+        }
+
+        // The rest of the budget is handled by the interpreter.
+        const t_block& block = aotBlocks[index];
+        if (block.count > budget)
+            break;
+
+        m_abort = 0;
+        uint32_t executed = block.code(*this, m_cpu);
+        m_cpu.m_instCounter += executed;
+        budget -= executed;
+
+        if (m_cpu.m_stop) {
+            uint32_t hit = m_cpu.m_stop & stopMask;
+            m_cpu.m_stop = 0;
+            if (hit)
+                return (Cpu65C02::t_stopReason) (hit & -hit);
+        }
+
+        // Only the last instruction of a block can jump back to itself.
+        if (executed == block.count && m_cpu.m_pc == block.lastPc && (stopMask & Cpu65C02::STOP_SELF_JUMP))
+            return Cpu65C02::STOP_SELF_JUMP;
+
+        // Polling loops are skipped by the interpreter.
+        if (executed == block.count && (uint16_t) (block.lastPc - m_cpu.m_pc) < Cpu65C02::IDLE_LOOP_BYTES &&
+            m_cpu.m_loops[block.lastPc] != Cpu65C02::LOOP_BUSY)
+            budget -= m_cpu.idle(block.lastPc, budget, Scheduler::NEVER, stopMask);
+    }
+
+    // Fall back to the interpreter.
+    return m_cpu.run(budget, stopMask);
+} // run
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include "cpu65c02.h"
+#include "decode.h"
+#include "variant.h"
+
+// Runs a ROM compiled ahead of time to native code.
+//
+// romcc finds the code reachable from the vectors of a ROM image, and writes
+// each basic block as a C++ function (romaot.cpp), with every instruction
+// expanded from the same execute() as the interpreter uses, for its opcode,
+// address and operand. Linked into the emulator, those functions take the
+// place of the interpreter wherever the PC is at the start of a block.
+//
+// The bytes of each block are compared with the memory before it is first
+// used, and again after something has been written to them, so a different
+// or modified ROM simply runs in the interpreter. So does any code that was
+// not found, e.g. only reached through an indirect jump, or in RAM.
+//
+// A block is only entered if no event can become due before it ends, and
+// it returns early after an instruction that may cause one (a write, CLI or
+// PLP), so interrupts are taken at exactly the same instruction as in the
+// interpreter.
+class CpuAot : public MemoryObserver
+{
+    public:
+        CpuAot(Cpu65C02& cpu);
+        ~CpuAot();
+
+        // Executes up to budget instructions, like Cpu65C02::run().
+        // Breakpoints, watchpoints, profiling and coverage are only
+        // supported by the interpreter, so they disable the compiled code.
+        // The code is for the WDC 65C02, so the other variants do too.
+        Cpu65C02::t_stopReason run(uint64_t budget, uint32_t stopMask = Cpu65C02::STOP_ALL);
+
+        // Called by the CPU when a cached instruction byte is overwritten.
+        virtual void invalidate(uint16_t addr);
+
+        // A compiled block. The code returns the number of instructions
+        // executed, which is less than count if it had to stop early.
+        typedef uint32_t (*t_code)(CpuAot& aot, Cpu65C02& cpu);
+        typedef struct {
+            uint16_t pc;
+            uint16_t lastPc;    // Address of the last instruction.
+            uint16_t size;      // Number of bytes.
+            uint16_t count;     // Number of instructions.
+            uint16_t cycles;    // Most clock cycles it can take.
+            t_code   code;
+        } t_block;
+
+        // Used by the generated code. The PC is known, so the compiler can
+        // work out everything that depends on it.
+        template <uint8_t OP, uint16_t PC>
+        static void execute(Cpu65C02& cpu, const Cpu65C02::t_decoded& d) {
+            cpu.m_pc = PC;
+            cpu.execute<Wdc65C02>(d, addrModes[OP], instructions[OP], cycles[OP]);
+        }
+        bool aborted() const {return m_abort;}
+
+        // True if the interpreter would now deal with an event or interrupt.
+        static bool eventDue(const Cpu65C02& cpu) {return cpu.m_cycles >= cpu.m_scheduler.next();}
+
+    private:
+        typedef enum {BLOCK_UNKNOWN, BLOCK_VALID, BLOCK_CHANGED} t_status;
+
+        Cpu65C02& m_cpu;
+        std::vector<int32_t> m_blockIndex;  // Indexed by PC. -1 means no block.
+        std::vector<uint8_t> m_status;      // t_status of each block.
+        std::vector<std::vector<int32_t> > m_pageBlocks;  // Blocks on each page.
+
+        volatile uint8_t m_abort;   // Set when a running block is invalidated.
+
+        bool verify(int32_t index);
+}; // end of class CpuAot
+
+// Generated by romcc, sorted by address.
+extern const CpuAot::t_block aotBlocks[];
+extern const size_t aotBlockCount;
+extern const uint8_t aotImage[65536];  // The image the blocks were compiled from.
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+// Edge coverage of the guest program, in the style of AFL.
+//
+// Each control transfer (branch taken or not, JMP, JSR, RTS, RTI, BRK,
+// BBR, BBS and interrupts) hashes its (from, to) pair into a map of 8-bit
+// hit counters. The counters wrap around, as in AFL.
+//
+// The map can be any memory, e.g. the shared memory of afl-fuzz or the
+// extra counters of libFuzzer, so that the fuzzer sees the coverage of the
+// guest instead of the emulator.
+//
+// The CPU only calls it from the instrumented run loop, which it uses while
+// coverage or a profiler is attached, so it costs nothing otherwise.
+class Coverage
+{
+    public:
+        // The size is a power of two, from 32 up to 65536. Without a map,
+        // one is allocated.
+        Coverage(size_t size = 65536, uint8_t* map = 0) : m_own(map ? 0 : size, 0),
+            m_map(map ? map : m_own.data()), m_mask(size - 1) {}
+
+        // Called by the CPU after each control transfer.
+        void edge(uint16_t from, uint16_t to) {
+            uint32_t hash = ((from * 0x9E3779B1u) >> 16) ^ ((to * 0x85EBCA77u) >> 17);
+            m_map[hash & m_mask] += 1;
+        }
+
+        void clear() {memset(m_map, 0, m_mask + 1);}
+
+        uint8_t* map() const {return m_map;}
+        size_t size() const {return m_mask + 1;}
+        size_t count() const;   // Number of counters that are not zero.
+
+    private:
+        std::vector<uint8_t> m_own;
+        uint8_t* m_map;
+        uint32_t m_mask;
+}; // end of class Coverage
+
+inline size_t Coverage::count() const
+{
+    size_t n = 0;
+    for (uint32_t i = 0; i <= m_mask; ++i)
+        n += (m_map[i] != 0);
+    return n;
+} // count
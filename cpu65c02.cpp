@@ -1,423 +1,641 @@
 #include <iostream>
-#include <iomanip>
 #include "cpu65c02.h"
+#include "decimal.h"
 #include "decode.h"
+#include "disas.h"
+#include "execute.h"
+#include "fusion.h"
+#include "recorder.h"
+#include "variant.h"
+
+// What the code outside the handlers needs of a variant.
+struct Cpu65C02::t_engine {
+    std::array<uint8_t, 256>   addrModes;      // addrMode_t
+    std::array<uint8_t, 256>   instructions;   // instruction_t
+    std::array<t_handler, 256> handlers;
+    t_handler (*fusedHandler)(uint8_t first, uint8_t second);
+    t_handler generic;      // The whole execute(), for ENGINE_SWITCH.
+    bool interruptClearsDecimal;
+};
 
 void Cpu65C02::reset()
 {
     m_pc = read16(0xFFFC);
-    m_flags.decimal = 0;
-    std::cout << "Resetting CPU. PC=" << std::hex << std::setw(4) << m_pc;
-    std::cout << std::dec << std::endl;
+    m_status &= ~FLAG_D;
     m_instCounter = 0;
+    m_cycles = 0;
 } // reset
 
-static uint8_t alu(uint8_t opcode, uint8_t arg1, uint8_t arg2, Cpu65C02::t_flags& flags)
+Cpu65C02::t_registers Cpu65C02::getRegisters() const
 {
-    uint16_t tmp16;
-    uint8_t  tmp8 = arg1;
+    t_registers regs;
+    regs.pc    = m_pc;
+    regs.areg  = m_areg;
+    regs.xreg  = m_xreg;
+    regs.yreg  = m_yreg;
+    regs.sp    = m_sp;
+    regs.flags = flags();
+    return regs;
+} // getRegisters
 
-    switch (opcode)
-    {
-        case ALU_ORA:
-            tmp8 = arg1 | arg2;
-            flags.sign = (tmp8 >> 7);
-            flags.zero = (tmp8 == 0);
-            break;
-        case ALU_AND:
-            tmp8 = arg1 & arg2;
-            flags.sign = (tmp8 >> 7);
-            flags.zero = (tmp8 == 0);
-            break;
-        case ALU_EOR:
-            tmp8 = arg1 ^ arg2;
-            flags.sign = (tmp8 >> 7);
-            flags.zero = (tmp8 == 0);
-            break;
-        case ALU_ADC:
-            tmp16 = arg1 + arg2 + flags.carry;
-            // Set S, Z, C, and V
-            flags.carry    = (tmp16 >> 8);
-            flags.overflow = ~((arg1 >> 7) ^ (arg2 >> 7)) & ((arg1 >> 7) ^ ((tmp16 >> 7) & 1));
-            tmp8 = tmp16 & 0xFF;
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_LDA:
-            tmp8 = arg2;
-            // Set S and Z
-            flags.sign = (tmp8 >> 7);
-            flags.zero = (tmp8 == 0);
-            break;
-        case ALU_CMP:
-            tmp16 = arg1 + ((~arg2) & 0xFF) + 1;
-            // Set S, Z, and C
-            flags.carry = (tmp16 >> 8);
-            tmp8 = tmp16 & 0xFF;
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_SBC:
-            tmp16 = arg1 + ((~arg2) & 0xFF) + flags.carry;
-            // Set S, Z, C, and V
-            flags.carry    = (tmp16 >> 8);
-            flags.overflow = ~((arg1 >> 7) ^ (~arg2 >> 7)) & ((arg1 >> 7) ^ ((tmp16 >> 7) & 1));
-            tmp8 = tmp16 & 0xFF;
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_ASL:
-            // Set S, Z, and C
-            tmp8 = (arg2 << 1) & 0xFF;
-            flags.carry = (arg2 >> 7);
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_ROL:
-            // Set S, Z, and C
-            tmp8 = ((arg2 << 1) + flags.carry) & 0xFF;
-            flags.carry = (arg2 >> 7);
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_LSR:
-            // Set S, Z, and C
-            tmp8 = (arg2 >> 1) & 0xFF;
-            flags.carry = (arg2 & 1);
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_ROR:
-            // Set S, Z, and C
-            tmp8 = (arg2 >> 1) & 0xFF;
-            if (flags.carry)
-                tmp8 |= 0x80;
-            flags.carry = (arg2 & 1);
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_DEC:
-            // Set S, and Z
-            tmp8 = (arg2 - 1) & 0xFF;
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_INC:
-            // Set S, and Z
-            tmp8 = (arg2 + 1) & 0xFF;
-            flags.sign  = (tmp8 >> 7);
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_BIT:
-            // Set S, Z, and V
-            tmp8 = arg1 & arg2;
-            flags.sign = arg2 >> 7;
-            flags.overflow = (arg2 >> 6) & 1;
-            flags.zero  = (tmp8 == 0);
-            break;
-        case ALU_TRB:
-            // Set V
-            tmp8 = arg1 & arg2;
-            flags.zero  = (tmp8 == 0);
-            tmp8 = arg2 & (~arg1);
-            break;
-        case ALU_TSB:
-            // Set V
-            tmp8 = arg1 & arg2;
-            flags.zero  = (tmp8 == 0);
-            tmp8 = arg2 | arg1;
-            break;
-    }
+void Cpu65C02::setRegisters(const t_registers& regs)
+{
+    m_pc    = regs.pc;
+    m_areg  = regs.areg;
+    m_xreg  = regs.xreg;
+    m_yreg  = regs.yreg;
+    m_sp    = regs.sp;
+    setFlags(regs.flags);
+} // setRegisters
+
+Cpu65C02::t_state Cpu65C02::getState() const
+{
+    t_state state;
+    state.registers    = getRegisters();
+    state.nmi          = m_nmi;
+    state.waiting      = m_waiting;
+    state.irqLines     = m_irqLines;
+    state.instructions = m_instCounter;
+    state.cycles       = m_cycles;
+    return state;
+} // getState
 
-    return tmp8;
-} // alu
+void Cpu65C02::setState(const t_state& state)
+{
+    setRegisters(state.registers);
+    m_nmi         = state.nmi;
+    m_waiting     = state.waiting;
+    m_irqLines    = state.irqLines;
+    m_instCounter = state.instructions;
+    m_cycles      = state.cycles;
+
+    // Our own events were posted for the old cycle count.
+    m_scheduler.cancel(this);
+    if (m_nmi || m_irqLines)
+        pollInterrupts();
+} // setState
+
+void Cpu65C02::setBreakpoint(uint16_t addr, bool enable, t_condition condition)
+{
+    uint64_t bit = 1ULL << (addr & 63);
+    m_breakpointCount += (int) enable - (int) breakpoint(addr);
+    m_breakpoints[addr >> 6] = enable ? (m_breakpoints[addr >> 6] | bit) : (m_breakpoints[addr >> 6] & ~bit);
+
+    if (enable && condition)
+        m_conditions[addr] = condition;
+    else
+        m_conditions.erase(addr);
+} // setBreakpoint
+
+bool Cpu65C02::atBreakpoint() const
+{
+    if (!breakpoint(m_pc))
+        return false;
+    auto it = m_conditions.find(m_pc);
+    return it == m_conditions.end() || it->second(getRegisters());
+} // atBreakpoint
+
+void Cpu65C02::watchpoint(uint16_t addr, bool)
+{
+    // The first access of the instruction is reported.
+    if (!(m_stop & STOP_WATCHPOINT))
+        m_stopAddress = addr;
+    m_stop |= STOP_WATCHPOINT;
+} // watchpoint
+
+// ADC or SBC in decimal mode, looked up in one of the decimal tables.
+// On the 65C02 it takes one cycle more than in binary mode.
+uint8_t Cpu65C02::decimal(const uint16_t* table, uint8_t arg, uint8_t cycles)
+{
+    uint16_t entry = table[decimalIndex(m_carry, m_areg, arg)];
+    m_carry    = (entry & DECIMAL_C) ? 1 : 0;
+    m_overflow = (entry & DECIMAL_V) ? 0x80 : 0;
+    m_sign     = (entry & DECIMAL_N) ? 0x80 : 0;
+    m_zero     = (entry & DECIMAL_Z) ? 0 : 1;
+    addCycles(cycles);
+    return entry & 0xFF;
+} // decimal
 
 static uint16_t sign_extend(uint8_t arg)
 {
     return (arg < 0x80) ? arg : 0xFF00 | arg;
 }
 
-void Cpu65C02::singleStep()
+// Decode the instruction bytes found at the given address.
+void Cpu65C02::decodeBytes(t_decoded& d, uint16_t addr, const uint8_t bytes[3], t_variant variant)
 {
-    // This is only used to detect jump and branch back to the same
-    // instruction, i.e. infinite loop.
-    uint16_t pc_old = m_pc;
+    const t_engine& e = engine(variant);
+    uint8_t inst = bytes[0];
+    d.handler     = e.handlers[inst];
+    d.opcode      = inst;
+    d.addrMode    = e.addrModes[inst];
+    d.instruction = e.instructions[inst];
+    d.operand     = 0;
+    d.zp          = 0;
+    d.bit         = 0;
 
-    uint8_t inst = m_memory.read(m_pc);
-    uint16_t pArg = 0;
-    uint8_t pArgBit = 0;
-    uint8_t pArgZp = 0;
+    uint8_t  arg8  = bytes[1];
+    uint16_t arg16 = (bytes[2] << 8) | arg8;
 
-    m_instCounter += 1;
+    switch (d.addrMode)
+    {
+        case AM_NONE :
+        case AM_ACC  :
+        case AM_RES  : d.length = 1; break;
+
+        case AM_IMM  :
+        case AM_ZP   :
+        case AM_ZPX  :
+        case AM_ZPY  :
+        case AM_INDX :
+        case AM_INDY :
+        case AM_IZP  : d.operand = arg8; d.length = 2; break;
+        case AM_REL  : d.operand = addr + sign_extend(arg8) + 2; d.length = 2; break;
+
+        case AM_ABS  :
+        case AM_ABSX :
+        case AM_ABSY :
+        case AM_IND  :
+        case AM_IABSX: d.operand = arg16; d.length = 3; break;
+        case AM_ZR   : d.bit     = (inst >> 4) & 7;
+                       d.zp      = arg8;
+                       d.operand = addr + sign_extend(bytes[2]) + 3; d.length = 3; break;
+    } // switch (d.addrMode)
+} // decodeBytes
+
+// Decode the instruction at the given address into the cache entry.
+void Cpu65C02::decodeAt(t_decoded& d, uint16_t addr)
+{
+    uint8_t bytes[3] = {m_memory.peek(addr), m_memory.peek(addr+1), m_memory.peek(addr+2)};
+    decodeBytes(d, addr, bytes, m_variant);
+
+    // Make sure we are told if any of the instruction bytes change.
+    for (uint8_t i = 0; i < d.length; ++i)
+        m_memory.watch(addr+i);
+} // decodeAt
+
+// Decode the instruction at the given address, unless it is already cached.
+// If it starts one of the pairs in fusion.h, the next one is decoded too,
+// and both are run by a fused handler.
+const Cpu65C02::t_decoded& Cpu65C02::decode(uint16_t addr)
+{
+    t_decoded& d = m_decoded[addr];
+    if (d.length)
+        return d;
+
+    decodeAt(d, addr);
 
-    // Get pointer to operand in memory.
-    switch (addrModes[inst])
+    uint32_t next = addr + d.length;
+    if (fusable((instruction_t) d.instruction) && next < 0x10000)
     {
-        case AM_IMM  : pArg = m_pc+1; m_pc += 2; break;
-        case AM_ABS  : pArg = read16(m_pc+1); m_pc += 3; break;
-        case AM_ZP   : pArg = m_memory.read(m_pc+1); m_pc += 2; break;
-        case AM_NONE : m_pc += 1; break;
-        case AM_ACC  : m_pc += 1; break;
-        case AM_ZPX  : pArg = (m_memory.read(m_pc+1) + m_xreg) & 0xFF; m_pc += 2; break;
-        case AM_ZPY  : pArg = (m_memory.read(m_pc+1) + m_yreg) & 0xFF; m_pc += 2; break;
-        case AM_ABSX : pArg = read16(m_pc+1) + m_xreg; m_pc += 3; break;
-        case AM_ABSY : pArg = read16(m_pc+1) + m_yreg; m_pc += 3; break;
-        case AM_IND  : pArg = read16(read16(m_pc+1)); m_pc += 3; break;
-        case AM_INDX : pArg = read16((m_memory.read(m_pc+1) + m_xreg) & 0xFF); m_pc += 2; break;
-        case AM_INDY : pArg = read16(m_memory.read(m_pc+1)) + m_yreg; m_pc += 2; break;
-        case AM_REL  : pArg = m_pc + sign_extend(m_memory.read(m_pc+1)) + 2; m_pc += 2; break;
-        case AM_RES  : std::cerr << "Unimplemented instruction" << std::endl; exit(-1); break;
-
-        case AM_IZP  : pArg = read16(m_memory.read(m_pc+1)); m_pc += 2; break;
-        case AM_IABSX: pArg = read16(read16(m_pc+1) + m_xreg); m_pc += 3; break;
-        case AM_ZR   : pArgBit = (m_memory.read(m_pc) >> 4) & 7;
-                       pArgZp  = m_memory.read(m_pc+1);
-                       pArg = m_pc + sign_extend(m_memory.read(m_pc+2)) + 3; m_pc += 3; break;
-    } // switch (addrModes[inst])
-
-    // Execute instruction.
-    m_memory.trace(true);
-    switch (instructions[inst])
+        t_handler fused = m_engine.fusedHandler(d.opcode, m_memory.peek(next));
+        if (fused) {
+            if (!m_decoded[next].length)
+                decodeAt(m_decoded[next], next);
+            d.handler = fused;
+        }
+    }
+    return d;
+} // decode
+
+// An instruction byte has been overwritten. Forget every cached instruction
+// that covers this address.
+void Cpu65C02::invalidate(uint16_t addr)
+{
+    for (uint8_t i = 0; i < 3; ++i)
     {
-        case I_RES: std::cerr << "Unimplemented instruction" << std::endl; exit(-1); break;
-
-        case I_ORA: m_areg = alu(ALU_ORA, m_areg, m_memory.read(pArg), m_flags); break;
-        case I_AND: m_areg = alu(ALU_AND, m_areg, m_memory.read(pArg), m_flags); break;
-        case I_EOR: m_areg = alu(ALU_EOR, m_areg, m_memory.read(pArg), m_flags); break;
-        case I_ADC: m_areg = alu(ALU_ADC, m_areg, m_memory.read(pArg), m_flags); break;
-        case I_STA: m_memory.write(pArg, m_areg); break;
-        case I_LDA: m_areg = alu(ALU_LDA, m_areg, m_memory.read(pArg), m_flags); break;
-        case I_CMP:          alu(ALU_CMP, m_areg, m_memory.read(pArg), m_flags); break;
-        case I_SBC: m_areg = alu(ALU_SBC, m_areg, m_memory.read(pArg), m_flags); break;
-        case I_STZ: m_memory.write(pArg, 0); break;
-
-        case I_CLC: m_flags.carry    = 0; break;
-        case I_SEC: m_flags.carry    = 1; break;
-        case I_CLI: m_flags.intmask  = 0; break;
-        case I_SEI: m_flags.intmask  = 1; break;
-        case I_CLV: m_flags.overflow = 0; break;
-        case I_CLD: m_flags.decimal  = 0; break;
-        case I_SED: m_flags.decimal  = 1; break;
-
-        case I_BPL: if (m_flags.sign     == 0) m_pc = pArg; break;
-        case I_BMI: if (m_flags.sign     == 1) m_pc = pArg; break;
-        case I_BVC: if (m_flags.overflow == 0) m_pc = pArg; break;
-        case I_BVS: if (m_flags.overflow == 1) m_pc = pArg; break;
-        case I_BCC: if (m_flags.carry    == 0) m_pc = pArg; break;
-        case I_BCS: if (m_flags.carry    == 1) m_pc = pArg; break;
-        case I_BNE: if (m_flags.zero     == 0) m_pc = pArg; break;
-        case I_BEQ: if (m_flags.zero     == 1) m_pc = pArg; break;
-        case I_BRA: m_pc = pArg; break;
-
-        case I_BBR: if ((~m_memory.read(pArgZp)) & (1 << pArgBit)) m_pc = pArg; break;
-        case I_BBS: if (  m_memory.read(pArgZp)  & (1 << pArgBit)) m_pc = pArg; break;
-        case I_TRB: m_memory.write(pArg, alu(ALU_TRB, m_areg, m_memory.read(pArg), m_flags)); break;
-        case I_TSB: m_memory.write(pArg, alu(ALU_TSB, m_areg, m_memory.read(pArg), m_flags)); break;
-        case I_RMB: m_memory.write(pArg, m_memory.read(pArg) & ~(1 << ((inst >> 4) & 7))); break;
-        case I_SMB: m_memory.write(pArg, m_memory.read(pArg) |  (1 << ((inst >> 4) & 7))); break;
-
-        case I_PHP: m_memory.write(0x0100 | m_sp, 0x30 | *(uint8_t*) &m_flags); m_sp -= 1; break;
-        case I_JSR: m_memory.write(0x0100 | m_sp, (m_pc-1) >> 8); m_memory.write(0x0100 | (m_sp-1), (m_pc-1) & 0xFF); m_sp -= 2; m_pc = pArg; break;
-        case I_PLP: m_sp += 1; *(uint8_t*) &m_flags = m_memory.read(0x0100 | m_sp); break;
-        case I_PHA: m_memory.write(0x0100 | m_sp, m_areg); m_sp -= 1; break;
-        case I_RTS: m_sp += 2; m_pc = read16(0x0100 | (m_sp-1)) + 1; break; 
-        case I_PLA: m_sp += 1; m_areg = alu(ALU_LDA, m_areg, m_memory.read(0x0100 | m_sp), m_flags); break;
-
-        case I_PHX: m_memory.write(0x0100 | m_sp, m_xreg); m_sp -= 1; break;
-        case I_PLX: m_sp += 1; m_xreg = alu(ALU_LDA, m_xreg, m_memory.read(0x0100 | m_sp), m_flags); break;
-        case I_PHY: m_memory.write(0x0100 | m_sp, m_yreg); m_sp -= 1; break;
-        case I_PLY: m_sp += 1; m_yreg = alu(ALU_LDA, m_yreg, m_memory.read(0x0100 | m_sp), m_flags); break;
-
-        case I_INCA: m_areg = alu(ALU_INC, 0, m_areg, m_flags); break;
-        case I_DECA: m_areg = alu(ALU_DEC, 0, m_areg, m_flags); break;
-        case I_ASLA: m_areg = alu(ALU_ASL, 0, m_areg, m_flags); break;
-        case I_ROLA: m_areg = alu(ALU_ROL, 0, m_areg, m_flags); break;
-        case I_LSRA: m_areg = alu(ALU_LSR, 0, m_areg, m_flags); break;
-        case I_RORA: m_areg = alu(ALU_ROR, 0, m_areg, m_flags); break;
-        case I_ASL: m_memory.write(pArg, alu(ALU_ASL, 0, m_memory.read(pArg), m_flags)); break;
-        case I_ROL: m_memory.write(pArg, alu(ALU_ROL, 0, m_memory.read(pArg), m_flags)); break;
-        case I_LSR: m_memory.write(pArg, alu(ALU_LSR, 0, m_memory.read(pArg), m_flags)); break;
-        case I_ROR: m_memory.write(pArg, alu(ALU_ROR, 0, m_memory.read(pArg), m_flags)); break;
-        case I_DEC: m_memory.write(pArg, alu(ALU_DEC, 0, m_memory.read(pArg), m_flags)); break;
-        case I_INC: m_memory.write(pArg, alu(ALU_INC, 0, m_memory.read(pArg), m_flags)); break;
-        case I_BIT: if ((addrModes[inst]) == AM_IMM) {
-                       t_flags temp_flags;
-                       alu(ALU_BIT, m_areg, m_memory.read(pArg), temp_flags);
-                       m_flags.zero = temp_flags.zero;
-                    }
-                    else
-                       alu(ALU_BIT, m_areg, m_memory.read(pArg), m_flags);
-                    break;
+        t_decoded& d = m_decoded[(uint16_t) (addr-i)];
+        if (d.length > i)
+            d.length = 0;
+    }
+
+    // So do the fused pairs, which may cover up to 5 bytes before it.
+    // They go back to running one instruction at a time.
+    for (uint8_t i = 1; i < 6; ++i)
+    {
+        t_decoded& d = m_decoded[(uint16_t) (addr-i)];
+        if (d.length)
+            d.handler = m_engine.handlers[d.opcode];
+    }
 
-        case I_STX: m_memory.write(pArg, m_xreg); break;
-        case I_LDX: m_xreg = alu(ALU_LDA, 0, m_memory.read(pArg), m_flags); break;
-        case I_CPX:          alu(ALU_CMP, m_xreg, m_memory.read(pArg), m_flags); break;
-        case I_INX: m_xreg = alu(ALU_INC, 0, m_xreg, m_flags); break;
-        case I_DEX: m_xreg = alu(ALU_DEC, 0, m_xreg, m_flags); break;
-        case I_TAX: m_xreg = alu(ALU_LDA, 0, m_areg, m_flags); break;
-        case I_TXA: m_areg = alu(ALU_LDA, 0, m_xreg, m_flags); break;
-        case I_TSX: m_xreg = alu(ALU_LDA, 0, m_sp, m_flags); break;
-        case I_TXS: m_sp = m_xreg; break;
-
-        case I_STY: m_memory.write(pArg, m_yreg); break;
-        case I_LDY: m_yreg = alu(ALU_LDA, 0, m_memory.read(pArg), m_flags); break;
-        case I_CPY:          alu(ALU_CMP, m_yreg, m_memory.read(pArg), m_flags); break;
-        case I_INY: m_yreg = alu(ALU_INC, 0, m_yreg, m_flags); break;
-        case I_DEY: m_yreg = alu(ALU_DEC, 0, m_yreg, m_flags); break;
-        case I_TAY: m_yreg = alu(ALU_LDA, 0, m_areg, m_flags); break;
-        case I_TYA: m_areg = alu(ALU_LDA, 0, m_yreg, m_flags); break;
-
-        case I_NOP: break;
-        case I_BRK: m_memory.write(0x0100 | m_sp, m_pc >> 8); m_memory.write(0x0100 | (m_sp-1), m_pc & 0xFF); m_sp -= 2;
-                    m_memory.write(0x0100 | m_sp, 0x30 | *(uint8_t*) &m_flags); m_sp -= 1;
-                    m_flags.intmask = 1;
-                    m_flags.decimal = 0;
-                    m_pc = read16(0xFFFE);
+    // Loops containing the byte have to be checked again.
+    for (unsigned i = 0; i < IDLE_LOOP_BYTES + 2; ++i)
+        m_loops[(uint16_t) (addr - 2 + i)] = LOOP_UNKNOWN;
+
+    if (m_codeObserver)
+        m_codeObserver->invalidate(addr);
+} // invalidate
+
+template <class VARIANT, uint8_t OP>
+void Cpu65C02::handler(Cpu65C02& cpu, const t_decoded& d)
+{
+    constexpr t_opcode opcode = VARIANT::opcode(OP);
+    cpu.execute<VARIANT>(d, opcode.addrMode, opcode.instruction, opcode.cycles);
+} // handler
+
+template <class VARIANT, size_t... OPS>
+constexpr std::array<Cpu65C02::t_handler, 256> Cpu65C02::makeHandlers(std::index_sequence<OPS...>)
+{
+    return {{ &Cpu65C02::handler<VARIANT, OPS>... }};
+} // makeHandlers
+
+// Switching on the addressing mode and instruction.
+template <class VARIANT>
+void Cpu65C02::genericHandler(Cpu65C02& cpu, const t_decoded& d)
+{
+    cpu.execute<VARIANT>(d, d.addrMode, d.instruction, VARIANT::opcode(d.opcode).cycles);
+} // genericHandler
+
+template <class VARIANT, uint8_t FIRST, uint8_t SECOND>
+void Cpu65C02::fusedHandler(Cpu65C02& cpu, const t_decoded& d)
+{
+    constexpr t_opcode first  = VARIANT::opcode(FIRST);
+    constexpr t_opcode second = VARIANT::opcode(SECOND);
+    cpu.execute<VARIANT>(d, first.addrMode, first.instruction, first.cycles);
+
+    // The run loop would stop here, or deal with an event first.
+    if (cpu.m_stop || cpu.m_instCounter >= cpu.m_fuseEnd ||
+            cpu.m_cycles >= cpu.m_fuseCycles || cpu.m_cycles >= cpu.m_scheduler.next())
+        return;
+
+    // The first instruction does not write to memory, so the second one,
+    // which follows it in the cache, is still valid.
+    cpu.m_fusedPc = cpu.m_pc;
+    cpu.m_instCounter += 1;
+    cpu.execute<VARIANT>((&d)[d.length], second.addrMode, second.instruction, second.cycles);
+} // fusedHandler
+
+template <class VARIANT, size_t... PAIRS>
+constexpr std::array<Cpu65C02::t_handler, sizeof...(PAIRS)> Cpu65C02::makeFusedHandlers(std::index_sequence<PAIRS...>)
+{
+    return {{ &Cpu65C02::fusedHandler<VARIANT, fusedPairs[PAIRS][0], fusedPairs[PAIRS][1]>... }};
+} // makeFusedHandlers
+
+template <class VARIANT>
+Cpu65C02::t_handler Cpu65C02::fusedHandler(uint8_t first, uint8_t second)
+{
+    const size_t pairs = sizeof(fusedPairs) / sizeof(fusedPairs[0]);
+    static const std::array<t_handler, pairs> fusedHandlers = makeFusedHandlers<VARIANT>(std::make_index_sequence<pairs>());
+    for (size_t i = 0; i < pairs; ++i)
+        if (fusedPairs[i][0] == first && fusedPairs[i][1] == second)
+            return fusedHandlers[i];
+    return 0;
+} // fusedHandler
+
+template <class VARIANT>
+constexpr Cpu65C02::t_engine Cpu65C02::makeEngine()
+{
+    t_engine e = {};
+    for (unsigned op = 0; op < 256; ++op)
+    {
+        e.addrModes[op]    = VARIANT::opcode(op).addrMode;
+        e.instructions[op] = VARIANT::opcode(op).instruction;
+    }
+    e.handlers     = makeHandlers<VARIANT>(std::make_index_sequence<256>());
+    e.fusedHandler = &fusedHandler<VARIANT>;
+    e.generic      = &genericHandler<VARIANT>;
+    e.interruptClearsDecimal = VARIANT::interruptClearsDecimal;
+    return e;
+} // makeEngine
+
+// One specialized handler for each of the 256 opcodes, for each variant.
+const Cpu65C02::t_engine Cpu65C02::engines[] = {
+    makeEngine<Wdc65C02>(), makeEngine<Rockwell65C02>(), makeEngine<Nmos6502>()
+};
+
+const Cpu65C02::t_engine& Cpu65C02::engine(t_variant variant)
+{
+    return engines[variant];
+} // engine
+
+Cpu65C02::t_handler Cpu65C02::unfusedHandler(uint8_t opcode) const
+{
+    return m_engine.handlers[opcode];
+} // unfusedHandler
+
+// Executes the instruction at the current PC.
+inline void Cpu65C02::step()
+{
+    // Executing the instruction may invalidate the cache entry. This only
+    // clears the length, which has been used by then.
+    const t_decoded& d = decode(m_pc);
+
+    m_instCounter += 1;
+
+    if (m_trace) {
+        uint8_t bytes[3] = {d.opcode, m_memory.peek(m_pc+1), m_memory.peek(m_pc+2)};
+        m_trace->instruction(m_pc, bytes, m_areg, m_xreg, m_yreg, m_sp, flags());
+    }
+
+#ifdef ENGINE_SWITCH
+    // Generic interpreter, switching on the addressing mode and instruction.
+    m_engine.generic(*this, d);
+#else
+    // Jump directly to the code specialized for this opcode.
+    d.handler(*this, d);
+#endif
+} // step
+
+void Cpu65C02::irq(uint32_t source, bool active)
+{
+    // While replaying, the interrupts come from the recording instead.
+    if (m_recorder && m_recorder->replaying())
+        return;
+
+    if (active)
+        m_irqLines |= source;
+    else
+        m_irqLines &= ~source;
+
+    if (m_recorder)
+        m_recorder->interrupt(m_irqLines, false);
+    if (m_irqLines)
+        pollInterrupts();
+} // irq
+
+void Cpu65C02::nmi()
+{
+    if (m_recorder && m_recorder->replaying())
+        return;
+
+    m_nmi = true;
+    if (m_recorder)
+        m_recorder->interrupt(m_irqLines, true);
+    pollInterrupts();
+} // nmi
+
+// Nothing to do here. The run loop calls interrupts() after the events.
+void Cpu65C02::event(uint64_t)
+{
+} // event
+
+void Cpu65C02::interrupts()
+{
+    if (m_nmi) {
+        m_nmi = false;
+        m_waiting = false;
+        interrupt(0xFFFA);
+    } else if (m_irqLines) {
+        // WAI ends even if the interrupt is masked.
+        m_waiting = false;
+        if (!(m_status & FLAG_I))
+            interrupt(0xFFFE);
+    }
+} // interrupts
+
+// Like BRK, except that the B flag is pushed as zero.
+void Cpu65C02::interrupt(uint16_t vector)
+{
+    if (m_profiler)
+        m_profiler->interrupt(m_pc, m_sp);
+    uint16_t from = m_pc;
+    m_memory.write(0x0100 | m_sp, m_pc >> 8);
+    m_memory.write(0x0100 | (m_sp-1), m_pc & 0xFF);
+    m_sp -= 2;
+    m_memory.write(0x0100 | m_sp, (0x20 | flags()) & ~FLAG_B);
+    m_sp -= 1;
+    m_status |= FLAG_I;
+    if (m_engine.interruptClearsDecimal)
+        m_status &= ~FLAG_D;
+    m_pc = read16(vector);
+    addCycles(7);
+    if (m_coverage)
+        m_coverage->edge(from, m_pc);
+} // interrupt
+
+// Check that the instructions from head up to the jump back at last only
+// read memory and registers, and do not jump anywhere but out of the loop.
+bool Cpu65C02::pollingLoop(uint16_t head, uint16_t last)
+{
+    uint16_t addr = head;
+    while (true)
+    {
+        const t_decoded& d = decode(addr);
+        switch (d.instruction)
+        {
+            case I_ORA: case I_AND: case I_EOR: case I_ADC: case I_SBC: case I_CMP:
+            case I_LDA: case I_LDX: case I_LDY: case I_CPX: case I_CPY: case I_BIT:
+            case I_CLC: case I_SEC: case I_CLI: case I_SEI: case I_CLV: case I_CLD: case I_SED:
+            case I_INX: case I_DEX: case I_INY: case I_DEY: case I_TAX: case I_TXA:
+            case I_TAY: case I_TYA: case I_TSX: case I_TXS: case I_INCA: case I_DECA:
+            case I_ASLA: case I_ROLA: case I_LSRA: case I_RORA: case I_NOP:
+                break;
+
+            // A branch to itself inside the loop has to stop the run loop.
+            case I_BPL: case I_BMI: case I_BVC: case I_BVS: case I_BCC: case I_BCS:
+            case I_BNE: case I_BEQ: case I_BRA: case I_BBR: case I_BBS:
+                if (d.operand == addr && addr != head)
+                    return false;
+                break;
+
+            case I_JMP:
+                if (addr == last && d.addrMode == AM_ABS)
                     break;
-        case I_RTI: m_sp += 1; *(uint8_t*) &m_flags = m_memory.read(0x0100 | m_sp);
-                    m_sp += 2; m_pc = read16(0x0100 | (m_sp-1));
-                    break; 
-
-        case I_JMP: m_pc = pArg; break;
-    } // switch (instructions[inst])
-    m_memory.trace(false);
-
-    if (pc_old == m_pc) {
-        std::cerr << "Infinite loop!" << std::endl;
-        std::cerr << std::dec << m_instCounter << " instructions executed" << std::endl;
-        exit(0);
+                return false;
+
+            default:
+                return false;
+        }
+
+        if (addr == last)
+            return true;
+        addr += d.length;
+        if ((uint16_t) (addr - head) > (uint16_t) (last - head))
+            return false;
     }
-} // singleStep
-
-void Cpu65C02::show() const
-{
-    std::cout << "PC: " << std::hex << std::setw(4) << m_pc;
-    std::cout << "  AREG : " << std::hex << std::setw(2) << (uint16_t) m_areg;
-    std::cout << "  XREG : " << std::hex << std::setw(2) << (uint16_t) m_xreg;
-    std::cout << "  YREG : " << std::hex << std::setw(2) << (uint16_t) m_yreg;
-    std::cout << "  SP : " << std::hex << std::setw(2) << (uint16_t) m_sp;
-    std::cout << "  FLAGS : ";
-    if (m_flags.sign)     std::cout << "S"; else std::cout << ".";
-    if (m_flags.overflow) std::cout << "V"; else std::cout << ".";
-    if (m_flags.reserved) std::cout << "R"; else std::cout << ".";
-    if (m_flags.brk)      std::cout << "B"; else std::cout << ".";
-    if (m_flags.decimal)  std::cout << "D"; else std::cout << ".";
-    if (m_flags.intmask)  std::cout << "I"; else std::cout << ".";
-    if (m_flags.zero)     std::cout << "Z"; else std::cout << ".";
-    if (m_flags.carry)    std::cout << "C"; else std::cout << ".";
-
-    std::cout << "   ";
-    disas();
-} // show
+} // pollingLoop
 
-// Disassemble the current instruction.
-void Cpu65C02::disas() const
+// Called after the instruction at addr has jumped back to a lower address.
+// If the loop only reads, it is executed once more. When that brings back
+// the same registers, without reading a device that may have changed, all
+// further iterations are the same up to the next event. Those are skipped.
+// Returns the number of instructions executed and skipped.
+uint64_t Cpu65C02::idle(uint16_t addr, uint64_t budget, uint64_t cycleLimit, uint32_t stopMask)
 {
-    uint8_t inst = m_memory.read(m_pc);
-    std::cout << std::hex << std::setw(2) << std::setfill('0') << (uint16_t) inst << " : ";
-    switch (instructions[inst])
+    uint16_t head = m_pc;
+    if (!m_skipIdle || m_trace || m_profiler || m_coverage || m_recorder)
+        return 0;
+
+    if (m_loops[addr] == LOOP_UNKNOWN)
+        m_loops[addr] = pollingLoop(head, addr) ? LOOP_POLLING : LOOP_BUSY;
+    if (m_loops[addr] != LOOP_POLLING)
+        return 0;
+
+    uint16_t length = addr - head + m_decoded[addr].length;
+    if (m_breakpointCount && (stopMask & STOP_BREAKPOINT))
+        for (uint16_t i = 0; i < length; ++i)
+            if (breakpoint(head + i))
+                return 0;
+    if (m_memory.watchpointCount() && (stopMask & STOP_WATCHPOINT))
+        return 0;
+
+    // The same checks as the run loop, before each instruction.
+    t_registers before = getRegisters();
+    uint64_t startCycles = m_cycles;
+    uint64_t reads = m_memory.volatileReads();
+    uint64_t startCount = m_instCounter;
+    uint64_t n = 0;
+    while (n < budget && n < length && m_cycles < m_scheduler.next() && m_cycles < cycleLimit)
     {
-        case I_RES: std::cout << "???"; break;
-        case I_ORA: std::cout << "ORA"; break;
-        case I_AND: std::cout << "AND"; break;
-        case I_EOR: std::cout << "EOR"; break;
-        case I_ADC: std::cout << "ADC"; break;
-        case I_STA: std::cout << "STA"; break;
-        case I_LDA: std::cout << "LDA"; break;
-        case I_CMP: std::cout << "CMP"; break;
-        case I_SBC: std::cout << "SBC"; break;
-        case I_CLC: std::cout << "CLC"; break;
-        case I_SEC: std::cout << "SEC"; break;
-        case I_CLI: std::cout << "CLI"; break;
-        case I_SEI: std::cout << "SEI"; break;
-        case I_CLV: std::cout << "CLV"; break;
-        case I_CLD: std::cout << "CLD"; break;
-        case I_SED: std::cout << "SED"; break;
-        case I_BPL: std::cout << "BPL"; break;
-        case I_BMI: std::cout << "BMI"; break;
-        case I_BVC: std::cout << "BVC"; break;
-        case I_BVS: std::cout << "BVS"; break;
-        case I_BCC: std::cout << "BCC"; break;
-        case I_BCS: std::cout << "BCS"; break;
-        case I_BNE: std::cout << "BNE"; break;
-        case I_BEQ: std::cout << "BEQ"; break;
-        case I_JMP: std::cout << "JMP"; break;
-        case I_PHP: std::cout << "PHP"; break;
-        case I_JSR: std::cout << "JSR"; break;
-        case I_PLP: std::cout << "PLP"; break;
-        case I_PHA: std::cout << "PHA"; break;
-        case I_RTS: std::cout << "RTS"; break;
-        case I_PLA: std::cout << "PLA"; break;
-        case I_ASL: std::cout << "ASL"; break;
-        case I_ASLA:std::cout << "ASL"; break;
-        case I_ROL: std::cout << "ROL"; break;
-        case I_ROLA:std::cout << "ROL"; break;
-        case I_LSR: std::cout << "LSR"; break;
-        case I_LSRA:std::cout << "LSR"; break;
-        case I_ROR: std::cout << "ROR"; break;
-        case I_RORA:std::cout << "ROR"; break;
-        case I_DEC: std::cout << "DEC"; break;
-        case I_DECA:std::cout << "DEC"; break;
-        case I_INC: std::cout << "INC"; break;
-        case I_INCA:std::cout << "INC"; break;
-        case I_BIT: std::cout << "BIT"; break;
-        case I_STX: std::cout << "STX"; break;
-        case I_LDX: std::cout << "LDX"; break;
-        case I_CPX: std::cout << "CPX"; break;
-        case I_INX: std::cout << "INX"; break;
-        case I_DEX: std::cout << "DEX"; break;
-        case I_TAX: std::cout << "TAX"; break;
-        case I_TXA: std::cout << "TXA"; break;
-        case I_TSX: std::cout << "TSX"; break;
-        case I_TXS: std::cout << "TXS"; break;
-        case I_STY: std::cout << "STY"; break;
-        case I_LDY: std::cout << "LDY"; break;
-        case I_CPY: std::cout << "CPY"; break;
-        case I_INY: std::cout << "INY"; break;
-        case I_DEY: std::cout << "DEY"; break;
-        case I_TAY: std::cout << "TAY"; break;
-        case I_TYA: std::cout << "TYA"; break;
-        case I_NOP: std::cout << "NOP"; break;
-        case I_BRK: std::cout << "BRK"; break;
-        case I_RTI: std::cout << "RTI"; break;
-
-        case I_PHX: std::cout << "PHX"; break;
-        case I_PHY: std::cout << "PHY"; break;
-        case I_PLX: std::cout << "PLX"; break;
-        case I_PLY: std::cout << "PLY"; break;
-        case I_BRA: std::cout << "BRA"; break;
-        case I_BBR: std::cout << "BBR"; break;
-        case I_BBS: std::cout << "BBS"; break;
-        case I_STZ: std::cout << "STZ"; break;
-        case I_TRB: std::cout << "TRB"; break;
-        case I_TSB: std::cout << "TSB"; break;
-        case I_RMB: std::cout << "RMB"; break;
-        case I_SMB: std::cout << "SMB"; break;
+        step();
+        n = m_instCounter - startCount;     // Two for a fused pair.
+        if (m_pc == head || (uint16_t) (m_pc - head) >= length)
+            break;
     }
-    switch (addrModes[inst])
+
+    t_registers after = getRegisters();
+    if (n == 0 || m_pc != head || m_memory.volatileReads() != reads ||
+        after.areg != before.areg || after.xreg != before.xreg || after.yreg != before.yreg ||
+        after.sp != before.sp || after.flags != before.flags)
+        return n;
+
+    // Skip whole iterations, so that the run loop takes over exactly where
+    // it would have been.
+    uint64_t loops = (budget - n) / n;
+#ifndef NO_CYCLES
+    uint64_t limit = std::min(m_scheduler.next(), cycleLimit);
+    uint64_t loopCycles = m_cycles - startCycles;
+    loops = std::min(loops, (limit > m_cycles) ? (limit - m_cycles) / loopCycles : 0);
+    m_cycles += loops * loopCycles;
+#else
+    (void) startCycles;
+#endif
+    m_instCounter += loops * n;
+    m_skipped += loops * n;
+    return n + loops * n;
+} // idle
+
+// Executes up to budget instructions, and with CYCLES until the cycle
+// counter reaches cycleLimit.
+// INSTRUMENTED is for profiling and coverage, which look at every
+// instruction.
+template <bool CYCLES, bool INSTRUMENTED>
+inline Cpu65C02::t_stopReason Cpu65C02::runLoop(uint64_t budget, uint64_t cycleLimit, uint32_t stopMask)
+{
+    const uint16_t start = m_pc;
+    uint64_t n = 0;
+
+    // Fused pairs need the same checks before their second instruction.
+    // Every instruction is looked at separately while tracing, profiling,
+    // recording coverage or with breakpoints.
+    bool fuse = !INSTRUMENTED && !m_trace && !(m_breakpointCount && (stopMask & STOP_BREAKPOINT));
+    m_fuseEnd    = !fuse ? 0 : (budget > ~0ULL - m_instCounter) ? ~0ULL : m_instCounter + budget;
+    m_fuseCycles = CYCLES ? cycleLimit : Scheduler::NEVER;
+    while (n < budget)
     {
-        case AM_IMM  : std::cout << " #$" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1); break;
-        case AM_ABS  : std::cout << " $" << std::hex << std::setfill('0') << std::setw(4) << read16(m_pc+1); break;
-        case AM_ZP   : std::cout << " $" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1); break;
-        case AM_NONE : break;
-        case AM_ACC  : std::cout << " A"; break;
-        case AM_ZPX  : std::cout << " $" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1) << ",X"; break;
-        case AM_ZPY  : std::cout << " $" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1) << ",Y"; break;
-        case AM_ABSX : std::cout << " $" << std::hex << std::setfill('0') << std::setw(4) << read16(m_pc+1) << ",X"; break;
-        case AM_ABSY : std::cout << " $" << std::hex << std::setfill('0') << std::setw(4) << read16(m_pc+1) << ",Y"; break;
-        case AM_IND  : std::cout << " ($" << std::hex << std::setfill('0') << std::setw(4) << read16(m_pc+1) << ")"; break;
-        case AM_INDX : std::cout << " ($" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1) << ",X)"; break;
-        case AM_INDY : std::cout << " ($" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1) << "),Y"; break;
-        case AM_REL  : std::cout << " $" << std::hex << std::setfill('0') << std::setw(4) << ((m_pc + 2 + sign_extend(m_memory.read(m_pc+1))) & 0xFFFF); break;
-
-        case AM_IZP  : std::cout << " ($" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1) << ")"; break;
-        case AM_IABSX: std::cout << " ($" << std::hex << std::setfill('0') << std::setw(4) << read16(m_pc+1) << ",X)"; break;
-        case AM_ZR   : std::cout << (uint16_t) ((m_memory.read(m_pc) >> 4) & 7);
-                       std::cout << " $" << std::hex << std::setfill('0') << std::setw(2) << (uint16_t) m_memory.read(m_pc+1) << ", ";
-                       std::cout << std::hex << std::setfill('0') << std::setw(4) << ((m_pc + 3 + sign_extend(m_memory.read(m_pc+2))) & 0xFFFF); break;
-        case AM_RES  : break;
-    } // switch (addrModes[inst])
-
-    std::cout << std::dec << std::endl;
+        if (CYCLES && m_cycles >= cycleLimit)
+            return STOP_BUDGET;
+
+        // Devices and interrupts are only looked at when an event is due.
+        if (m_cycles >= m_scheduler.next()) {
+            m_scheduler.dispatch(m_cycles);
+            interrupts();
+        }
+
+        if (m_waiting) {
+#ifndef NO_CYCLES
+            // Skip straight to the next event, or the end of the time slice.
+            uint64_t next = m_scheduler.next();
+            if (CYCLES && next > cycleLimit)
+                next = cycleLimit;
+            if (next == Scheduler::NEVER)
+                return STOP_WAIT;
+            m_cycles = next;
+            continue;
+#else
+            return STOP_WAIT;   // Without cycle counting, time stands still.
+#endif
+        }
+
+        // A breakpoint at the starting address is ignored, so that
+        // execution can be resumed from a breakpoint. One at an interrupt
+        // handler taken right away is not.
+        if (m_breakpointCount && breakpoint(m_pc) && (n > 0 || m_pc != start) &&
+                (stopMask & STOP_BREAKPOINT) && atBreakpoint()) {
+            m_stopAddress = m_pc;
+            return STOP_BREAKPOINT;
+        }
+
+        // This is only used to detect jump and branch back to the same
+        // instruction, i.e. infinite loop.
+        uint16_t pc_old = m_pc;
+        uint64_t count  = m_instCounter;
+
+        // The instruction may overwrite itself, so it is looked at before.
+        bool transfer = false;
+        if (INSTRUMENTED) {
+            const t_decoded& d = decode(m_pc);
+            if (m_profiler)
+                m_profiler->instruction(m_pc, d.opcode, m_sp);
+            transfer = m_coverage && endsBlock((instruction_t) d.instruction);
+        }
+        step();
+        if (INSTRUMENTED && transfer)
+            m_coverage->edge(pc_old, m_pc);
+        n += 1;
+
+        // A fused pair has executed two instructions. The checks below are
+        // for the second one.
+        if (m_instCounter != count + 1) {
+            pc_old = m_fusedPc;
+            n += 1;
+        }
+
+        if (m_stop) {
+            uint32_t hit = m_stop & stopMask;
+            m_stop = 0;
+            if (hit)
+                return (t_stopReason) (hit & -hit);
+        }
+
+        if (pc_old == m_pc && (stopMask & STOP_SELF_JUMP))
+            return STOP_SELF_JUMP;
+
+        // A short jump back may be a loop polling for something to change.
+        if ((uint16_t) (pc_old - m_pc) < IDLE_LOOP_BYTES && m_loops[pc_old] != LOOP_BUSY)
+            n += idle(pc_old, budget - n, CYCLES ? cycleLimit : Scheduler::NEVER, stopMask);
+    }
+
+    return STOP_BUDGET;
+} // runLoop
+
+Cpu65C02::t_stopReason Cpu65C02::run(uint64_t budget, uint32_t stopMask)
+{
+    if (m_profiler || m_coverage)
+        return runLoop<false, true>(budget, 0, stopMask);
+    return runLoop<false, false>(budget, 0, stopMask);
+} // run
+
+#ifndef NO_CYCLES
+Cpu65C02::t_stopReason Cpu65C02::runCycles(uint64_t cycles, uint32_t stopMask)
+{
+    if (m_profiler || m_coverage)
+        return runLoop<true, true>(~0ULL, m_cycles + cycles, stopMask);
+    return runLoop<true, false>(~0ULL, m_cycles + cycles, stopMask);
+} // runCycles
+#endif
+
+void Cpu65C02::show(std::ostream& os) const
+{
+    Trace::t_record record;
+    record.pc       = m_pc;
+    record.bytes[0] = m_memory.peek(m_pc);
+    record.bytes[1] = m_memory.peek(m_pc+1);
+    record.bytes[2] = m_memory.peek(m_pc+2);
+    record.areg     = m_areg;
+    record.xreg     = m_xreg;
+    record.yreg     = m_yreg;
+    record.sp       = m_sp;
+    record.flags    = flags();
+    Trace::printState(os, record);
+    os << std::endl;
+} // show
+
+// Disassemble the current instruction.
+void Cpu65C02::disas(std::ostream& os) const
+{
+    uint8_t bytes[3] = {m_memory.peek(m_pc), m_memory.peek(m_pc+1), m_memory.peek(m_pc+2)};
+    disassemble(os, m_pc, bytes);
+    os << std::endl;
 } // disas
 
@@ -1,47 +1,316 @@
 #pragma once
 
+#include <array>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include "coverage.h"
 #include "memory.h"
+#include "profile.h"
+#include "scheduler.h"
 
-class Cpu65C02
+class Recorder;
+
+class Cpu65C02 : public MemoryObserver, public EventHandler
 {
+    friend class CpuAot;
+    friend class CpuJit;
+
     public:
-        Cpu65C02(Memory& memory) : m_memory(memory) {reset();}
+        // The CPU variants. Each one has its own decode tables and handlers
+        // (see variant.h), so the run loop does not depend on it.
+        typedef enum {
+            CPU_65C02,      // WDC 65C02, with WAI and STP.
+            CPU_R65C02,     // Rockwell 65C02, with the bit instructions, but without WAI and STP.
+            CPU_6502        // NMOS 6502, without the undocumented opcodes.
+        } t_variant;
+
+        Cpu65C02(Memory& memory, t_variant variant = CPU_65C02) : m_memory(memory),
+            m_variant(variant), m_engine(engine(variant)), m_decoded(65536), m_codeObserver(0), m_trace(0), m_profiler(0), m_coverage(0), m_recorder(0),
+            m_breakpoints(1024, 0), m_breakpointCount(0), m_stop(0), m_stopAddress(0),
+            m_loops(65536, LOOP_UNKNOWN), m_skipIdle(true), m_skipped(0),
+            m_irqLines(0), m_nmi(false), m_waiting(false),
+            m_pc(0), m_areg(0), m_xreg(0), m_yreg(0), m_sp(0xFF),
+            m_fuseEnd(0), m_fuseCycles(0), m_fusedPc(0)
+        {
+            setFlags(0);
+            m_memory.setObserver(this);
+            reset();
+        }
+
+        // Reasons for run() to return. These are also used as a bit mask,
+        // to select the reasons that should stop execution.
+        typedef enum {
+            STOP_BUDGET     = 0x01,   // The requested number of instructions is executed.
+            STOP_SELF_JUMP  = 0x02,   // A jump or branch to itself, i.e. infinite loop.
+            STOP_BREAKPOINT = 0x04,   // The PC has reached a breakpoint.
+            STOP_ILLEGAL    = 0x08,   // Unimplemented opcode. It is not executed.
+            STOP_BRK        = 0x10,   // A BRK instruction has been executed.
+            STOP_WAIT       = 0x20,   // WAI with nothing scheduled to wake it up. Always stops.
+            STOP_WATCHPOINT = 0x40,   // A watched address has been accessed, by the last instruction.
+            STOP_STP        = 0x80,   // STP has stopped the clock. The PC stays on it until reset().
+            STOP_ALL        = 0xFF
+        } t_stopReason;
 
         void reset();       // Resets the Program Counter.
-        void singleStep();  // Executes a single instruction.
-        void show() const;  // Dump the current state of the CPU.
-        void disas() const; // Disassemble the current instruction.
-
-        // The Flags register is implemented as a bitfield.
-        // This is not very portable, because the C++ language
-        // does not guarantee a specific ordering of the bits.
-        // But here the intended ordering is that CARRY 
-        // is in bit 0 and SIGN is in bit 7.
+        t_variant variant() const {return m_variant;}
+
+        // The registers visible to the program.
         typedef struct {
-            uint8_t carry:1;      // C
-            uint8_t zero:1;       // Z
-            uint8_t intmask:1;    // I
-            uint8_t decimal:1;    // D
-            uint8_t brk:1;        // B
-            uint8_t reserved:1;   // R
-            uint8_t overflow:1;   // V
-            uint8_t sign:1;       // S
-        } t_flags;        
+            uint16_t pc;
+            uint8_t  areg;
+            uint8_t  xreg;
+            uint8_t  yreg;
+            uint8_t  sp;
+            uint8_t  flags;
+        } t_registers;
+
+        t_registers getRegisters() const;
+        void setRegisters(const t_registers& regs);
+
+        // Everything else needed to continue later from the same point,
+        // e.g. from a Snapshot. Scheduled device events are not included.
+        typedef struct {
+            t_registers registers;
+            uint8_t  nmi;           // NMI triggered, but not taken yet.
+            uint8_t  waiting;       // Sleeping after WAI.
+            uint32_t irqLines;
+            uint64_t instructions;
+            uint64_t cycles;
+        } t_state;
+
+        t_state getState() const;
+        void setState(const t_state& state);
+
+        // Executes up to budget instructions. Returns early if any of the
+        // reasons in stopMask occurs.
+        t_stopReason run(uint64_t budget, uint32_t stopMask = STOP_ALL);
+
+#ifndef NO_CYCLES
+        // Executes instructions until at least the given number of clock
+        // cycles have passed, e.g. to run in time slices alongside other
+        // emulated components. Returns STOP_BUDGET when the time is up.
+        t_stopReason runCycles(uint64_t cycles, uint32_t stopMask = STOP_ALL);
+#endif
+        t_stopReason singleStep() {return run(1);}
+
+        // Stop before the instruction at addr is executed. A condition on
+        // the registers is only evaluated when the PC gets there. Nothing
+        // is checked while no breakpoints are set.
+        typedef std::function<bool(const t_registers&)> t_condition;
+        void setBreakpoint(uint16_t addr, bool enable, t_condition condition = t_condition());
+        bool breakpoint(uint16_t addr) const {return (m_breakpoints[addr >> 6] >> (addr & 63)) & 1;}
+        bool atBreakpoint() const;      // A breakpoint at the PC, whose condition is true.
+
+        // Stop after an instruction that reads and/or writes addr (see
+        // Memory::setWatchpoint()). Only the pages with watchpoints are slower.
+        void setWatchpoint(uint16_t addr, uint8_t kinds) {m_memory.setWatchpoint(addr, kinds);}
+
+        // The PC at a breakpoint, or the data address of a watchpoint, that
+        // stopped execution last.
+        uint16_t stopAddress() const {return m_stopAddress;}
+        uint64_t instructionCount() const {return m_instCounter;}
+        uint64_t cycleCount() const {return m_cycles;}   // Always zero if built with NO_CYCLES.
+
+        // A short loop that only reads memory, and comes back to where it
+        // started with the same registers, is waiting for something to
+        // change. That can only happen at the next scheduled event, so the
+        // iterations until then are skipped (they are included in
+        // instructionCount() and cycleCount()). Disabled while tracing,
+        // profiling or recording.
+        void setSkipIdle(bool enable) {m_skipIdle = enable;}
+        uint64_t skippedCount() const {return m_skipped;}  // Instructions skipped so far.
+        void show(std::ostream& os = std::cout) const;  // Dump the current state of the CPU.
+        void disas(std::ostream& os = std::cout) const; // Disassemble the current instruction.
+
+        // Devices post their events here. The cycles are those of cycleCount().
+        Scheduler& scheduler() {return m_scheduler;}
+
+        // Interrupt inputs. The IRQ input is level triggered, and active as
+        // long as any source (a bit chosen by each device) is active. NMI is
+        // triggered by calling nmi(). Both are taken between instructions,
+        // and wake up the CPU after WAI.
+        void irq(uint32_t source, bool active);
+        void nmi();
+
+        // Record every instruction executed. The memory must use the same trace.
+        void setTrace(Trace* trace) {m_trace = trace;}
+
+        // Count the instructions executed, by address and by routine. Set
+        // to null to stop. The JIT uses the interpreter while profiling.
+        void setProfiler(Profiler* profiler) {m_profiler = profiler;}
+
+        // Record edge coverage. Set to null to stop. Like profiling, this
+        // is only done by the interpreter, and idle loops are not skipped.
+        void setCoverage(Coverage* coverage) {m_coverage = coverage;}
+
+        // Log the interrupts for replay. Set by the Recorder itself.
+        void setRecorder(Recorder* recorder) {m_recorder = recorder;}
+
+        // The bits of the status register, as pushed by PHP.
+        enum {
+            FLAG_C = 0x01,  // Carry
+            FLAG_Z = 0x02,  // Zero
+            FLAG_I = 0x04,  // Interrupt mask
+            FLAG_D = 0x08,  // Decimal
+            FLAG_B = 0x10,  // Break
+            FLAG_R = 0x20,  // Reserved
+            FLAG_V = 0x40,  // Overflow
+            FLAG_N = 0x80   // Sign
+        };
+
+        // An instruction decoded once and cached by address. The operand
+        // bytes are resolved as far as possible without knowing the
+        // register contents, e.g. branch targets are already absolute.
+        struct t_decoded;
+        typedef void (*t_handler)(Cpu65C02& cpu, const t_decoded& d);
+        struct t_decoded {
+            t_handler handler;    // Specialized code for this opcode.
+            uint8_t  opcode;
+            uint8_t  addrMode;    // addrMode_t
+            uint8_t  instruction; // instruction_t
+            uint8_t  length;      // Number of bytes. Zero means not decoded.
+            uint16_t operand;     // Address, immediate or branch target.
+            uint8_t  zp;          // Zero-page address (only used by AM_ZR).
+            uint8_t  bit;         // Bit number (only used by AM_ZR).
+        };
+
+        // Decode the instruction bytes found at addr. Used by the other
+        // engines, which keep their own copies of the decoded instructions.
+        static void decodeBytes(t_decoded& d, uint16_t addr, const uint8_t bytes[3], t_variant variant = CPU_65C02);
+
+        // Called by the memory when a cached instruction byte is overwritten.
+        virtual void invalidate(uint16_t addr);
+
+        // Called by the memory when a watchpoint is hit.
+        virtual void watchpoint(uint16_t addr, bool write);
+
+        // Anyone else caching instructions (e.g. the JIT) can be told too.
+        void setCodeObserver(MemoryObserver* observer) {m_codeObserver = observer;}
+
+        // Called by the scheduler when an interrupt may have to be taken.
+        virtual void event(uint64_t cycle);
 
     private:
+        // The decode tables and handlers of a variant.
+        struct t_engine;
+        static const t_engine engines[];    // In the order of t_variant.
+        static const t_engine& engine(t_variant variant);
+        t_handler unfusedHandler(uint8_t opcode) const;    // For the JIT, which does not fuse.
+
         Memory&  m_memory;  // Reference to the external memory.
+        t_variant m_variant;
+        const t_engine& m_engine;
+        std::vector<t_decoded> m_decoded;   // Indexed by the Program Counter.
+        MemoryObserver* m_codeObserver;
+        Trace*   m_trace;
+        Profiler* m_profiler;
+        Coverage* m_coverage;
+        Recorder* m_recorder;
+        std::vector<uint64_t> m_breakpoints;    // One bit per address.
+        std::unordered_map<uint16_t, t_condition> m_conditions;
+        uint32_t m_breakpointCount;
+        uint32_t m_stop;    // Stop reasons raised by the current instruction.
+        uint16_t m_stopAddress;
+
+        // Idle loop detection, by the address of the jump back.
+        static const unsigned IDLE_LOOP_BYTES = 32;     // Longest loop considered.
+        typedef enum {LOOP_UNKNOWN, LOOP_BUSY, LOOP_POLLING} t_loop;
+        std::vector<uint8_t> m_loops;   // t_loop
+        bool     m_skipIdle;
+        uint64_t m_skipped;
+
+        Scheduler m_scheduler;
+        uint32_t m_irqLines;    // Active IRQ sources.
+        bool     m_nmi;         // NMI triggered, but not taken yet.
+        bool     m_waiting;     // Sleeping after WAI.
 
         uint16_t m_pc;
         uint8_t  m_areg;
         uint8_t  m_xreg;
         uint8_t  m_yreg;
         uint8_t  m_sp;
-        t_flags  m_flags;
-        uint32_t m_instCounter;
 
-        // Perform a 16-bit read from memory
+        // The status register is not updated by every instruction. Instead
+        // the values the flags are derived from are kept, and the register
+        // is only put together by flags() when it is actually needed.
+        uint8_t  m_sign;        // S is bit 7.
+        uint8_t  m_zero;        // Z is set if this is zero.
+        uint8_t  m_carry;       // C, either 0 or 1.
+        uint8_t  m_overflow;    // V is bit 7.
+        uint8_t  m_status;      // The remaining bits: I, D, B and R.
+        uint64_t m_instCounter;
+        uint64_t m_cycles;
+
+        const t_decoded& decode(uint16_t addr);
+        void decodeAt(t_decoded& d, uint16_t addr);
+        inline void step();
+
+        // Executes a decoded instruction, as the VARIANT does. When called
+        // with constant mode and instruction (as the per-opcode handlers do)
+        // the compiler reduces this to just the code for that single opcode.
+        template <class VARIANT> inline void execute(const t_decoded& d, uint8_t addrMode, uint8_t instruction, uint8_t cycles);
+        inline uint8_t alu(uint8_t op, uint8_t arg1, uint8_t arg2);
+        uint8_t decimal(const uint16_t* table, uint8_t arg, uint8_t cycles);
+
+        uint8_t flags() const {
+            return (m_sign & FLAG_N) | ((m_overflow >> 1) & FLAG_V) | m_status |
+                   (m_zero ? 0 : FLAG_Z) | m_carry;
+        }
+        void setFlags(uint8_t flags) {
+            m_sign     = flags;
+            m_zero     = (~flags) & FLAG_Z;
+            m_carry    = flags & FLAG_C;
+            m_overflow = flags << 1;
+            m_status   = flags & (FLAG_I | FLAG_D | FLAG_B | FLAG_R);
+        }
+
+        // Take an interrupt, if one is pending and allowed.
+        void interrupts();
+        void interrupt(uint16_t vector);
+
+        // Have interrupts() called before the next instruction.
+        void pollInterrupts() {m_scheduler.post(m_cycles, this);}
+
+        bool pollingLoop(uint16_t head, uint16_t last);
+        uint64_t idle(uint16_t addr, uint64_t budget, uint64_t cycleLimit, uint32_t stopMask);
+
+        template <bool CYCLES, bool INSTRUMENTED> inline t_stopReason runLoop(uint64_t budget, uint64_t cycleLimit, uint32_t stopMask);
+
+        // Clock cycle accounting, which disappears when built with NO_CYCLES.
+        void addCycles(uint64_t cycles) {
+#ifndef NO_CYCLES
+            m_cycles += cycles;
+#else
+            (void) cycles;
+#endif
+        }
+        // A branch taken costs one cycle, and one more to another page.
+        void branch(uint16_t target) {
+            addCycles(1 + ((m_pc ^ target) > 0xFF));
+            m_pc = target;
+        }
+
+        template <class VARIANT, uint8_t OP> static void handler(Cpu65C02& cpu, const t_decoded& d);
+        template <class VARIANT, size_t... OPS> static constexpr std::array<t_handler, 256> makeHandlers(std::index_sequence<OPS...>);
+        template <class VARIANT> static void genericHandler(Cpu65C02& cpu, const t_decoded& d);
+        template <class VARIANT> static constexpr t_engine makeEngine();
+
+        // Handlers for the instruction pairs in fusion.h. The second
+        // instruction is only executed if the run loop would have gone on
+        // to it, i.e. when nothing needs to be looked at in between.
+        template <class VARIANT, uint8_t FIRST, uint8_t SECOND> static void fusedHandler(Cpu65C02& cpu, const t_decoded& d);
+        template <class VARIANT, size_t... PAIRS> static constexpr std::array<t_handler, sizeof...(PAIRS)> makeFusedHandlers(std::index_sequence<PAIRS...>);
+        template <class VARIANT> static t_handler fusedHandler(uint8_t first, uint8_t second);   // Null if not fused.
+        uint64_t m_fuseEnd;     // Instruction count at the end of the budget. Zero while not fusing.
+        uint64_t m_fuseCycles;  // Cycle limit of the run loop.
+        uint16_t m_fusedPc;     // Address of the second instruction of the last pair.
+
+        // Perform a 16-bit read from memory, low byte first.
         uint16_t read16(uint16_t addr) const {
-            return (m_memory.read(addr+1) << 8) | m_memory.read(addr);
+            uint8_t low = m_memory.read(addr);
+            return (m_memory.read(addr+1) << 8) | low;
         }
 }; // end of class Cpu65C02
 
@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include "memory.h"
+#include "cpu65c02.h"
+#ifdef ENGINE_JIT
+#include "jit.h"
+#endif
+
+// Timing loops for the CPU. Each synthetic kernel exercises one class of
+// instructions; it is loaded at $C000 and ends with a jump to itself. ROM
+// images given on the command line (e.g. the functional tests) are run
+// the same way, starting at their reset vector.
+typedef struct {
+    const char*          name;
+    std::vector<uint8_t> code;
+} t_benchmark;
+
+static const t_benchmark kernels[] = {
+    // Arithmetic and logic on every X, like the binary ADC/SBC loops of the
+    // functional tests. Runs about 31 million instructions.
+    {"alu", {
+        0xA9, 0x20,         //        LDA #$20
+        0x85, 0x14,         //        STA $14
+        0xA2, 0x00,         //        LDX #0
+        0xA0, 0x00,         //        LDY #0
+        0x8A,               // loop:  TXA
+        0x18,               //        CLC
+        0x65, 0x10,         //        ADC $10
+        0x85, 0x11,         //        STA $11
+        0x45, 0x12,         //        EOR $12
+        0x38,               //        SEC
+        0xE5, 0x11,         //        SBC $11
+        0x2A,               //        ROL A
+        0x29, 0x7F,         //        AND #$7F
+        0xC5, 0x10,         //        CMP $10
+        0x05, 0x13,         //        ORA $13
+        0x4A,               //        LSR A
+        0xE6, 0x10,         //        INC $10
+        0xCA,               //        DEX
+        0xD0, 0xE8,         //        BNE loop
+        0x88,               //        DEY
+        0xD0, 0xE5,         //        BNE loop
+        0xC6, 0x14,         //        DEC $14
+        0xD0, 0xE1,         //        BNE loop
+        0x4C, 0x27, 0xC0    // done:  JMP done
+    }},
+    // Read-modify-write on zero page and absolute addresses, indexed or
+    // not. The loop counter is outside the zero page, which the indexed
+    // instructions write all over. About 25 million instructions.
+    {"rmw", {
+        0xA9, 0x20,         //        LDA #$20
+        0x8D, 0x00, 0x07,   //        STA $0700
+        0xA2, 0x00,         //        LDX #0
+        0xA0, 0x00,         //        LDY #0
+        0xE6, 0x10,         // loop:  INC $10
+        0xF6, 0x20,         //        INC $20,X
+        0x1E, 0x00, 0x02,   //        ASL $0200,X
+        0x4E, 0x00, 0x03,   //        LSR $0300
+        0x26, 0x11,         //        ROL $11
+        0x76, 0x30,         //        ROR $30,X
+        0xC6, 0x12,         //        DEC $12
+        0xFE, 0x00, 0x04,   //        INC $0400,X
+        0x1C, 0x00, 0x05,   //        TRB $0500
+        0x0C, 0x00, 0x06,   //        TSB $0600
+        0xCA,               //        DEX
+        0xD0, 0xE4,         //        BNE loop
+        0x88,               //        DEY
+        0xD0, 0xE1,         //        BNE loop
+        0xCE, 0x00, 0x07,   //        DEC $0700
+        0xD0, 0xDC,         //        BNE loop
+        0x4C, 0x2D, 0xC0    // done:  JMP done
+    }},
+    // Pushes and pulls of every register, and a subroutine call.
+    // About 29 million instructions.
+    {"stack", {
+        0xA9, 0x20,         //        LDA #$20
+        0x8D, 0x00, 0x07,   //        STA $0700
+        0xA2, 0x00,         //        LDX #0
+        0xA0, 0x00,         //        LDY #0
+        0x48,               // loop:  PHA
+        0xDA,               //        PHX
+        0x5A,               //        PHY
+        0x08,               //        PHP
+        0x20, 0x22, 0xC0,   //        JSR sub
+        0x28,               //        PLP
+        0x7A,               //        PLY
+        0xFA,               //        PLX
+        0x68,               //        PLA
+        0xCA,               //        DEX
+        0xD0, 0xF2,         //        BNE loop
+        0x88,               //        DEY
+        0xD0, 0xEF,         //        BNE loop
+        0xCE, 0x00, 0x07,   //        DEC $0700
+        0xD0, 0xEA,         //        BNE loop
+        0x4C, 0x1F, 0xC0,   // done:  JMP done
+        0x48,               // sub:   PHA
+        0x68,               //        PLA
+        0x60                //        RTS
+    }},
+    // Conditional branches, both taken and not taken, and BBR and BRA.
+    // About 31 million instructions.
+    {"branch", {
+        0xA9, 0x20,         //        LDA #$20
+        0x8D, 0x00, 0x07,   //        STA $0700
+        0xA2, 0x00,         //        LDX #0
+        0xA0, 0x00,         //        LDY #0
+        0x8A,               // loop:  TXA
+        0x29, 0x01,         //        AND #$01
+        0xF0, 0x01,         //        BEQ even
+        0xEA,               //        NOP
+        0x8A,               // even:  TXA
+        0x4A,               //        LSR A
+        0xB0, 0x01,         //        BCS odd
+        0xEA,               //        NOP
+        0xE0, 0x80,         // odd:   CPX #$80
+        0x90, 0x01,         //        BCC low
+        0xEA,               //        NOP
+        0x0F, 0x10, 0x01,   // low:   BBR0 $10,zero
+        0xEA,               //        NOP
+        0x80, 0x01,         // zero:  BRA next
+        0xEA,               //        NOP
+        0x50, 0x01,         // next:  BVC cont
+        0xEA,               //        NOP
+        0xCA,               // cont:  DEX
+        0xD0, 0xE3,         //        BNE loop
+        0x88,               //        DEY
+        0xD0, 0xE0,         //        BNE loop
+        0xCE, 0x00, 0x07,   //        DEC $0700
+        0xD0, 0xDB,         //        BNE loop
+        0x4C, 0x2E, 0xC0    // done:  JMP done
+    }},
+    // Indirect addressing in all modes, including the indirect jumps.
+    // About 23 million instructions.
+    {"indirect", {
+        0xA9, 0x02,         //        LDA #$02
+        0x85, 0x41,         //        STA $41
+        0xA9, 0x03,         //        LDA #$03
+        0x85, 0x43,         //        STA $43
+        0xA9, 0x29,         //        LDA #<next
+        0x85, 0x50,         //        STA $50
+        0xA9, 0xC0,         //        LDA #>next
+        0x85, 0x51,         //        STA $51
+        0xA9, 0x20,         //        LDA #$20
+        0x8D, 0x00, 0x07,   //        STA $0700
+        0xA2, 0x00,         //        LDX #0
+        0xA0, 0x00,         //        LDY #0
+        0xB1, 0x40,         // loop:  LDA ($40),Y
+        0x18,               //        CLC
+        0x71, 0x42,         //        ADC ($42),Y
+        0x91, 0x42,         //        STA ($42),Y
+        0xA1, 0x40,         //        LDA ($40,X)
+        0x52, 0x42,         //        EOR ($42)
+        0x92, 0x40,         //        STA ($40)
+        0x6C, 0x50, 0x00,   //        JMP ($0050)
+        0x7C, 0x3C, 0xC0,   // next:  JMP (table,X)
+        0x88,               // cont:  DEY
+        0xD0, 0xEA,         //        BNE loop
+        0xCE, 0x01, 0x07,   //        DEC $0701
+        0xD0, 0xE5,         //        BNE loop
+        0xCE, 0x00, 0x07,   //        DEC $0700
+        0xD0, 0xE0,         //        BNE loop
+        0x4C, 0x39, 0xC0,   // done:  JMP done
+        0x2C, 0xC0          // table: .word cont
+    }},
+};
+
+// The execution engine the CPU was compiled with.
+static const char* engine()
+{
+#if defined(ENGINE_JIT)
+    return "jit";
+#elif defined(ENGINE_SWITCH)
+    return "switch";
+#else
+    return "handlers";
+#endif
+} // engine
+
+// The result of all runs of one benchmark.
+typedef struct {
+    std::string name;
+    uint64_t instructions;
+    uint64_t cycles;
+    bool     finished;      // Ended in a jump to itself.
+    double   mean;          // Million instructions per second.
+    double   stddev;
+    double   best;
+    double   seconds;       // Mean time of a run.
+} t_result;
+
+// Run the image once, from reset until it jumps to itself.
+static double runOnce(const std::vector<uint8_t>& rom, t_result& result)
+{
+    Memory mem(rom);
+    Cpu65C02 cpu(mem);
+    const uint32_t stopMask = Cpu65C02::STOP_SELF_JUMP | Cpu65C02::STOP_ILLEGAL;
+
+    auto start = std::chrono::steady_clock::now();
+#ifdef ENGINE_JIT
+    CpuJit jit(cpu);
+    Cpu65C02::t_stopReason reason = jit.run(2000000000, stopMask);
+#else
+    Cpu65C02::t_stopReason reason = cpu.run(2000000000, stopMask);
+#endif
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    result.instructions = cpu.instructionCount();
+    result.cycles       = cpu.cycleCount();
+    result.finished     = (reason == Cpu65C02::STOP_SELF_JUMP);
+    return seconds;
+} // runOnce
+
+static t_result measure(const std::string& name, const std::vector<uint8_t>& rom, unsigned runs)
+{
+    t_result result;
+    result.name = name;
+
+    std::vector<double> mips;
+    double total = 0;
+    for (unsigned i = 0; i < runs; ++i)
+    {
+        double seconds = runOnce(rom, result);
+        mips.push_back(result.instructions / seconds / 1e6);
+        total += seconds;
+    }
+
+    double sum = 0, squares = 0;
+    for (double value : mips)
+        sum += value;
+    result.mean = sum / runs;
+    for (double value : mips)
+        squares += (value - result.mean) * (value - result.mean);
+    result.stddev  = (runs > 1) ? std::sqrt(squares / (runs - 1)) : 0;
+    result.best    = *std::max_element(mips.begin(), mips.end());
+    result.seconds = total / runs;
+    return result;
+} // measure
+
+// The best MIPS of each benchmark in a file written with -out.
+static std::map<std::string, double> loadResults(const std::string& fileName)
+{
+    std::map<std::string, double> results;
+    std::ifstream file(fileName);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, '\t'))
+            fields.push_back(field);
+        if (fields.size() >= 9)
+            results[fields[2]] = atof(fields[8].c_str());
+    }
+    return results;
+} // loadResults
+
+int main(int argc, char* argv[])
+{
+    unsigned runs = 5;
+    double threshold = 5;   // Percent slower that counts as a regression.
+    std::string outName, label, compareName;
+    std::vector<std::string> romNames;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-runs") == 0 && i+1 < argc)
+            runs = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "-out") == 0 && i+1 < argc)
+            outName = argv[++i];
+        else if (strcmp(argv[i], "-label") == 0 && i+1 < argc)
+            label = argv[++i];
+        else if (strcmp(argv[i], "-compare") == 0 && i+1 < argc)
+            compareName = argv[++i];
+        else if (strcmp(argv[i], "-threshold") == 0 && i+1 < argc)
+            threshold = atof(argv[++i]);
+        else if (argv[i][0] == '-') {
+            std::cerr << "Usage: cpubench [-runs n] [-out file] [-label text] [-compare file [-threshold percent]] [rom files]" << std::endl;
+            return 2;
+        }
+        else
+            romNames.push_back(argv[i]);
+    }
+
+    std::vector<t_result> results;
+    for (const t_benchmark& kernel : kernels)
+    {
+        // A 16 KB image at $C000, with the reset vector pointing to the start.
+        std::vector<uint8_t> rom(0x4000, 0);
+        std::copy(kernel.code.begin(), kernel.code.end(), rom.begin());
+        rom[0x3FFC] = 0x00;
+        rom[0x3FFD] = 0xC0;
+        results.push_back(measure(kernel.name, rom, runs));
+    }
+    for (const std::string& romName : romNames)
+    {
+        std::ifstream stream(romName, std::ios::in | std::ios::binary);
+        std::vector<uint8_t> rom((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        if (rom.empty() || rom.size() > 65536) {
+            std::cerr << "Can not read " << romName << std::endl;
+            return 2;
+        }
+        std::string name = romName.substr(romName.find_last_of('/') + 1);
+        results.push_back(measure(name.substr(0, name.find('.')), rom, runs));
+    }
+
+    std::map<std::string, double> baseline;
+    if (!compareName.empty())
+        baseline = loadResults(compareName);
+
+    std::cout << "Engine " << engine() << ", best and mean of " << runs << " runs" << std::endl;
+    std::cout << "benchmark      instructions      MIPS  stddev    best     MHz  ns/inst";
+    std::cout << (baseline.empty() ? "" : "  change") << std::endl;
+    bool slower = false;
+    for (const t_result& result : results)
+    {
+        std::cout << std::left << std::setw(12) << result.name << std::right;
+        std::cout << std::setw(15) << result.instructions << std::fixed << std::setprecision(1);
+        std::cout << std::setw(10) << result.mean << std::setw(8) << result.stddev << std::setw(8) << result.best;
+        std::cout << std::setw(8) << result.cycles / result.seconds / 1e6;
+        std::cout << std::setprecision(2) << std::setw(9) << 1000 / result.mean;
+
+        // The best runs are compared, since they are the least disturbed.
+        auto it = baseline.find(result.name);
+        if (it != baseline.end() && it->second > 0) {
+            double change = 100 * (result.best / it->second - 1);
+            std::cout << std::setprecision(1) << std::setw(7) << std::showpos << change << "%" << std::noshowpos;
+            if (change < -threshold) {
+                std::cout << " slower";
+                slower = true;
+            }
+        }
+        if (!result.finished)
+            std::cout << "  (did not finish)";
+        std::cout << std::endl;
+    }
+
+    // One line per benchmark, separated by tabs.
+    if (!outName.empty())
+    {
+        std::ofstream out(outName);
+        out << "# label\tengine\tbenchmark\tinstructions\tcycles\truns\tmips_mean\tmips_stddev\tmips_best\tmhz\tns_per_instruction" << std::endl;
+        for (const t_result& result : results)
+        {
+            out << label << "\t" << engine() << "\t" << result.name << "\t";
+            out << result.instructions << "\t" << result.cycles << "\t" << runs << "\t";
+            out << std::fixed << std::setprecision(2) << result.mean << "\t" << result.stddev << "\t" << result.best << "\t";
+            out << result.cycles / result.seconds / 1e6 << "\t" << std::setprecision(3) << 1000 / result.mean << std::endl;
+        }
+        if (!out) {
+            std::cerr << "Can not write " << outName << std::endl;
+            return 2;
+        }
+    }
+
+    return slower ? 1 : 0;
+} // main
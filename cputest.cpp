@@ -0,0 +1,372 @@
+#include <algorithm>
+#include <iostream>
+#include "memory.h"
+#include "cpu65c02.h"
+#include "farm.h"
+#include "jit.h"
+#include "lanes.h"
+#include "timer.h"
+#include "tracestream.h"
+
+// Checks of what the functional tests do not cover, like interrupts and
+// the engines agreeing with each other. Each program is loaded at $C000,
+// with the IRQ handler at $C100. "make test" runs them all.
+
+// Raises IRQ while a non-zero value is written to it.
+class IrqLine : public Device
+{
+    public:
+        IrqLine(Cpu65C02& cpu) : m_cpu(cpu) {}
+        virtual uint8_t read(uint16_t) {return 0;}
+        virtual void write(uint16_t, uint8_t value) {m_cpu.irq(1, value != 0);}
+
+    private:
+        Cpu65C02& m_cpu;
+}; // end of class IrqLine
+
+// Lowers IRQ, from both IrqLine and the timer, and logs the address the
+// interrupt returns to at $0200,Y.
+static const std::vector<uint8_t> irqLogger = {
+    0x9C, 0x00, 0xD0,   //        STZ $D000
+    0xAD, 0x03, 0xD1,   //        LDA $D103
+    0xBA,               //        TSX
+    0xBD, 0x02, 0x01,   //        LDA $0102,X
+    0x99, 0x00, 0x02,   //        STA $0200,Y
+    0xBD, 0x03, 0x01,   //        LDA $0103,X
+    0x99, 0x01, 0x02,   //        STA $0201,Y
+    0xC8,               //        INY
+    0xC8,               //        INY
+    0x40                //        RTI
+};
+
+// 64 KB with the program at $C000 and the IRQ handler at $C100.
+static std::vector<uint8_t> image(const std::vector<uint8_t>& program, const std::vector<uint8_t>& handler = irqLogger)
+{
+    std::vector<uint8_t> data(65536, 0);
+    std::copy(program.begin(), program.end(), data.begin() + 0xC000);
+    std::copy(handler.begin(), handler.end(), data.begin() + 0xC100);
+    data[0xFFFC] = 0x00; data[0xFFFD] = 0xC0;
+    data[0xFFFE] = 0x00; data[0xFFFF] = 0xC1;
+    return data;
+} // image
+
+// A machine with the image, IrqLine at $D000 and a Timer at $D100.
+class Machine
+{
+    public:
+        Machine(const std::vector<uint8_t>& program, const std::vector<uint8_t>& handler = irqLogger) :
+            m_memory(image(program, handler)), m_cpu(m_memory), m_irq(m_cpu), m_timer(m_cpu) {
+            m_memory.mapDevice(0xD0, 0xD0, &m_irq);
+            m_memory.mapDevice(0xD1, 0xD1, &m_timer);
+        }
+
+        Memory&   memory() {return m_memory;}
+        Cpu65C02& cpu()    {return m_cpu;}
+        Timer&    timer()  {return m_timer;}
+
+    private:
+        Memory   m_memory;
+        Cpu65C02 m_cpu;
+        IrqLine  m_irq;
+        Timer    m_timer;
+}; // end of class Machine
+
+// Runs the program until it jumps to itself, on the interpreter and on the
+// JIT, and compares the registers, the log of the IRQ handler and the
+// counts.
+static bool sameOnJit(const std::vector<uint8_t>& program)
+{
+    Machine interpreted(program);
+    Cpu65C02::t_stopReason reason = interpreted.cpu().run(100000, Cpu65C02::STOP_SELF_JUMP);
+
+    Machine translated(program);
+    CpuJit jit(translated.cpu());
+    bool ok = jit.run(100000, Cpu65C02::STOP_SELF_JUMP) == reason;
+
+    Cpu65C02::t_registers a = interpreted.cpu().getRegisters(), b = translated.cpu().getRegisters();
+    ok = ok && a.pc == b.pc && a.areg == b.areg && a.xreg == b.xreg && a.yreg == b.yreg &&
+              a.sp == b.sp && a.flags == b.flags;
+    for (uint16_t addr = 0x0200; addr < 0x0300; ++addr)
+        ok = ok && interpreted.memory().peek(addr) == translated.memory().peek(addr);
+    return ok && interpreted.cpu().instructionCount() == translated.cpu().instructionCount() &&
+                 interpreted.cpu().cycleCount() == translated.cpu().cycleCount();
+} // sameOnJit
+
+// Interrupts are taken by the JIT at the same instruction as by the
+// interpreter: when let in by CLI or PLP in the middle of a block, and
+// when raised by a timer at any instruction.
+static bool jitInterrupts()
+{
+    const std::vector<uint8_t> program = {
+        0xA2, 0xFF,         //        LDX #$FF
+        0x9A,               //        TXS
+        0xA0, 0x00,         //        LDY #0
+        0x78,               //        SEI
+        0xA9, 0x01,         //        LDA #1
+        0x8D, 0x00, 0xD0,   //        STA $D000
+        0x58,               //        CLI
+        0xEA,               //        NOP         ; $C00C
+        0xEA,               //        NOP
+        0x78,               //        SEI
+        0xA9, 0x01,         //        LDA #1
+        0x8D, 0x00, 0xD0,   //        STA $D000
+        0xA9, 0x00,         //        LDA #0
+        0x48,               //        PHA
+        0x28,               //        PLP
+        0xEA,               //        NOP         ; $C018
+        0xEA,               //        NOP
+        0x4C, 0x1A, 0xC0    // done:  JMP done
+    };
+
+    Machine interpreted(program);
+    interpreted.cpu().run(1000, Cpu65C02::STOP_SELF_JUMP);
+    const uint8_t expected[] = {0x0C, 0xC0, 0x18, 0xC0};
+    bool ok = sameOnJit(program) && interpreted.cpu().getRegisters().pc == 0xC01A;
+    for (uint16_t i = 0; i < sizeof(expected); ++i)
+        ok = ok && interpreted.memory().peek(0x0200 + i) == expected[i];
+
+    // A timer interrupting a run of NOPs longer than a block, every 60
+    // cycles, which ends with a jump to itself.
+    std::vector<uint8_t> timed = {
+        0xA2, 0xFF,         //        LDX #$FF
+        0x9A,               //        TXS
+        0xA0, 0x00,         //        LDY #0
+        0xA9, 0x3C,         //        LDA #60
+        0x8D, 0x00, 0xD1,   //        STA $D100
+        0x9C, 0x01, 0xD1,   //        STZ $D101
+        0xA9, 0x03,         //        LDA #3
+        0x8D, 0x02, 0xD1,   //        STA $D102
+        0x58                //        CLI
+    };
+    timed.insert(timed.end(), 100, 0xEA);               //        NOP ...
+    timed.insert(timed.end(), {0x4C, 0x77, 0xC0});      // done:  JMP done
+
+    Machine timer(timed);
+    timer.cpu().run(100000, Cpu65C02::STOP_SELF_JUMP);
+#ifndef NO_CYCLES
+    // Several interrupts in the NOPs.
+    ok = ok && timer.cpu().getRegisters().yreg >= 6;
+#endif
+    return ok && sameOnJit(timed);
+} // jitInterrupts
+
+// WAI with an IRQ asserted, even a masked one, continues at once.
+static bool waiWithIrq()
+{
+    const std::vector<uint8_t> program = {
+        0x78,               //        SEI
+        0xA9, 0x01,         //        LDA #1
+        0x8D, 0x00, 0xD0,   //        STA $D000
+        0xCB,               //        WAI
+        0x9C, 0x00, 0xD0,   //        STZ $D000
+        0x4C, 0x0A, 0xC0    // done:  JMP done
+    };
+
+    Machine machine(program);
+    Cpu65C02::t_stopReason reason = machine.cpu().run(1000, Cpu65C02::STOP_SELF_JUMP);
+    return reason == Cpu65C02::STOP_SELF_JUMP && machine.cpu().getRegisters().pc == 0xC00A;
+} // waiWithIrq
+
+#ifndef NO_CYCLES
+// A timer whose period is cleared while it runs stops after the next event.
+// Without cycle counting the timer never fires.
+static bool timerStops()
+{
+    const std::vector<uint8_t> program = {
+        0xA9, 0x10,         //        LDA #$10
+        0x8D, 0x00, 0xD1,   //        STA $D100
+        0x9C, 0x01, 0xD1,   //        STZ $D101
+        0xA9, 0x01,         //        LDA #1
+        0x8D, 0x02, 0xD1,   //        STA $D102
+        0x9C, 0x00, 0xD1,   //        STZ $D100
+        0xA2, 0x10,         //        LDX #16
+        0xCA,               // loop:  DEX
+        0xD0, 0xFD,         //        BNE loop
+        0x4C, 0x15, 0xC0    // done:  JMP done
+    };
+
+    Machine machine(program);
+    Cpu65C02::t_stopReason reason = machine.cpu().run(1000, Cpu65C02::STOP_SELF_JUMP);
+    Timer& timer = machine.timer();
+    return reason == Cpu65C02::STOP_SELF_JUMP && timer.read(0xD103) == 0x80 && timer.read(0xD103) == 0;
+} // timerStops
+#endif
+
+// A farm job started from a snapshot counts only the instructions it ran.
+static bool farmFromSnapshot()
+{
+    const std::vector<uint8_t> program = {
+        0xA2, 0x20,         //        LDX #32
+        0xCA,               // loop:  DEX
+        0xD0, 0xFD,         //        BNE loop
+        0x4C, 0x05, 0xC0    // done:  JMP done
+    };
+
+    Machine whole(program);
+    whole.cpu().run(1000, Cpu65C02::STOP_SELF_JUMP);
+
+    Machine part(program);
+    part.cpu().run(21);
+    Snapshot snapshot;
+    snapshot.save(part.cpu(), part.memory());
+
+    std::vector<uint8_t> rom = image(program);
+    Farm::t_job job = {};
+    job.rom      = &rom;
+    job.start    = &snapshot;
+    job.budget   = 1000;
+    job.stopMask = Cpu65C02::STOP_SELF_JUMP;
+    job.variant  = Cpu65C02::CPU_65C02;
+    Farm::t_result result = Farm(1).run({job})[0];
+    return result.reason == Cpu65C02::STOP_SELF_JUMP &&
+           result.instructions == whole.cpu().instructionCount() - 21;
+} // farmFromSnapshot
+
+// An image page mapped as RAM again keeps its contents, and is writable.
+static bool imageToRam()
+{
+    std::vector<uint8_t> page(256, 0x42);
+    Memory memory;
+    memory.mapImage(0x80, 0x80, page.data());
+    memory.mapRam(0x80, 0x80);
+    memory.write(0x8001, 0x24);
+    return memory.peek(0x8000) == 0x42 && memory.peek(0x8001) == 0x24 && page[1] == 0x42;
+} // imageToRam
+
+// A trace streamed from a ring too small for the writer to keep up with
+// has blocks missing, but every block in the file is the right one.
+static bool streamedBlocks()
+{
+    const char* fileName = "cputest.stream";
+    Trace trace(4 * Trace::blockRecords);
+    TraceWriter writer(trace, fileName);
+    const uint8_t bytes[3] = {0xEA, 0, 0};
+    for (uint64_t n = 0; n < 400 * Trace::blockRecords; ++n)
+        trace.instruction(n & 0xFFFF, bytes, n >> 16, n >> 24, 0, 0xFF, 0x20);
+    bool ok = writer.finish();
+
+    TraceReader reader;
+    ok = ok && reader.open(fileName);
+    std::vector<Trace::t_record> records;
+    for (size_t block = 0; ok && block < reader.blocks(); ++block)
+    {
+        ok = reader.read(block, records);
+        for (uint64_t i = 0; ok && i < records.size(); ++i)
+        {
+            uint64_t n = reader.first(block) + i;
+            ok = records[i].pc == (n & 0xFFFF) && records[i].areg == ((n >> 16) & 0xFF);
+        }
+    }
+    remove(fileName);
+    return ok && reader.blocks() + writer.dropped() == 400;
+} // streamedBlocks
+
+// Lanes given different inputs take different ways through the program,
+// and still end exactly as on Cpu65C02. They run together again where
+// the ways meet, instead of being split off.
+static bool lanesMatchScalar()
+{
+    std::vector<uint8_t> program = {
+        0xA2, 0xFF,         //        LDX #$FF
+        0x9A,               //        TXS
+        0xA5, 0x10,         //        LDA $10     ; the input
+        0x85, 0x11,         //        STA $11
+        0xA0, 0x08,         //        LDY #8
+        0xA9, 0x00,         //        LDA #0
+        0x85, 0x12,         //        STA $12
+        0x46, 0x11,         // bits:  LSR $11
+        0x90, 0x06,         //        BCC zero
+        0x20, 0x40, 0xC0,   //        JSR add
+        0x4C, 0x19, 0xC0,   //        JMP next
+        0xC6, 0x13,         // zero:  DEC $13
+        0x88,               // next:  DEY
+        0xD0, 0xF1,         //        BNE bits
+        0xA6, 0x10,         //        LDX $10
+        0xF0, 0x07,         //        BEQ done
+        0x8A,               // fill:  TXA
+        0x9D, 0x00, 0x03,   //        STA $0300,X
+        0xCA,               //        DEX
+        0xD0, 0xF9,         //        BNE fill
+        0xF8,               // done:  SED
+        0xA5, 0x12,         //        LDA $12
+        0x18,               //        CLC
+        0x65, 0x10,         //        ADC $10
+        0xD8,               //        CLD
+        0x85, 0x15,         //        STA $15
+        0x08,               //        PHP
+        0x68,               //        PLA
+        0x85, 0x16,         //        STA $16
+        0x4C, 0x34, 0xC0    // end:   JMP end
+    };
+    const std::vector<uint8_t> add = {
+        0x98,               // add:   TYA
+        0x18,               //        CLC
+        0x65, 0x12,         //        ADC $12
+        0x85, 0x12,         //        STA $12
+        0x60                //        RTS
+    };
+    program.resize(0x40, 0xEA);
+    program.insert(program.end(), add.begin(), add.end());
+    const std::vector<uint8_t> rom = image(program);
+    const uint32_t stopMask = Cpu65C02::STOP_SELF_JUMP | Cpu65C02::STOP_ILLEGAL;
+
+    bool ok = true;
+    for (uint64_t budget : {100000, 150, 0})
+    {
+        CpuLanes lanes(rom);
+        uint64_t total = 0;
+        for (unsigned l = 0; l < CpuLanes::LANES; ++l)
+            lanes.poke(l, 0x0010, l * 0x35 + (l >> 2));
+        lanes.run(budget, stopMask);
+
+        for (unsigned l = 0; l < CpuLanes::LANES; ++l)
+        {
+            Memory memory(rom);
+            memory.write(0x0010, l * 0x35 + (l >> 2));
+            Cpu65C02 cpu(memory);
+            Cpu65C02::t_stopReason reason = cpu.run(budget, stopMask);
+
+            const CpuLanes::t_result& result = lanes.result(l);
+            Cpu65C02::t_registers a = result.registers, b = cpu.getRegisters();
+            total += result.instructions;
+            ok = ok && result.reason == reason && result.instructions == cpu.instructionCount() &&
+                 a.pc == b.pc && a.areg == b.areg && a.xreg == b.xreg && a.yreg == b.yreg &&
+                 a.sp == b.sp && a.flags == b.flags;
+            for (unsigned addr = 0; addr < 65536; ++addr)
+                ok = ok && lanes.peek(l, addr) == memory.peek(addr);
+        }
+        // Most of the work is done in lockstep, although only a few
+        // lanes go the same way through the bits loop.
+        ok = ok && lanes.lockstepInstructions() * 4 >= total * 3;
+    }
+    return ok;
+} // lanesMatchScalar
+
+typedef struct {
+    const char* name;
+    bool (*check)();
+} t_test;
+
+static const t_test tests[] = {
+    {"jit interrupts", jitInterrupts},
+    {"wai with irq", waiWithIrq},
+#ifndef NO_CYCLES
+    {"timer stops", timerStops},
+#endif
+    {"farm from snapshot", farmFromSnapshot},
+    {"image to ram", imageToRam},
+    {"streamed blocks", streamedBlocks},
+    {"lanes match scalar", lanesMatchScalar},
+};
+
+int main()
+{
+    unsigned failed = 0;
+    for (const t_test& test : tests)
+    {
+        bool ok = test.check();
+        std::cout << (ok ? "ok     " : "FAILED ") << test.name << std::endl;
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+} // main
@@ -0,0 +1,71 @@
+#include "decimal.h"
+
+// N and Z taken from the result.
+static constexpr uint16_t flags(int result)
+{
+    return ((result & 0x80) ? DECIMAL_N : 0) | (((result & 0xFF) == 0) ? DECIMAL_Z : 0);
+} // flags
+
+// ADC as described in "Decimal Mode" by Bruce Clark, appendix A. V is
+// computed from the sum of the signed high nibbles, after the adjustment
+// of the low nibble. On the NMOS 6502 so is N, and Z is that of the
+// binary sum.
+static constexpr uint16_t adc(int carry, int a, int b, bool nmos)
+{
+    int low = (a & 0x0F) + (b & 0x0F) + carry;
+    if (low >= 0x0A)
+        low = ((low + 0x06) & 0x0F) + 0x10;
+
+    int sum    = (int8_t) (a & 0xF0) + (int8_t) (b & 0xF0) + low;
+    int result = (a & 0xF0) + (b & 0xF0) + low;
+    if (result >= 0xA0)
+        result += 0x60;
+
+    uint16_t nz = nmos ? (flags(sum) & DECIMAL_N) | (flags(a + b + carry) & DECIMAL_Z) : flags(result);
+    return (result & 0xFF) | ((result >= 0x100) ? DECIMAL_C : 0) |
+           ((sum < -128 || sum > 127) ? DECIMAL_V : 0) | nz;
+} // adc
+
+// SBC, with C and V the same as in binary mode. The 65C02 adjusts the
+// result as a whole, the NMOS 6502 nibble by nibble, and leaves N and Z as
+// in binary mode too.
+static constexpr uint16_t sbc(int carry, int a, int b, bool nmos)
+{
+    int low    = (a & 0x0F) - (b & 0x0F) + carry - 1;
+    int result = a - b + carry - 1;
+    uint8_t binary = result;
+    bool overflow = (a ^ b) & (a ^ binary) & 0x80;
+    bool borrow   = result < 0;
+    uint16_t nz   = nmos ? flags(binary) : 0;
+    if (nmos) {
+        if (low < 0)
+            low = ((low - 0x06) & 0x0F) - 0x10;
+        result = (a & 0xF0) - (b & 0xF0) + low;
+        if (result < 0)
+            result -= 0x60;
+    } else {
+        if (result < 0)
+            result -= 0x60;
+        if (low < 0)
+            result -= 0x06;
+        nz = flags(result);
+    }
+
+    return (result & 0xFF) | (borrow ? 0 : DECIMAL_C) | (overflow ? DECIMAL_V : 0) | nz;
+} // sbc
+
+static constexpr t_decimalTables makeTables(bool nmos)
+{
+    t_decimalTables tables = {};
+    for (int carry = 0; carry < 2; ++carry)
+        for (int a = 0; a < 256; ++a)
+            for (int b = 0; b < 256; ++b)
+            {
+                tables.adc[decimalIndex(carry, a, b)] = adc(carry, a, b, nmos);
+                tables.sbc[decimalIndex(carry, a, b)] = sbc(carry, a, b, nmos);
+            }
+    return tables;
+} // makeTables
+
+extern constexpr t_decimalTables decimalTables     = makeTables(false);
+extern constexpr t_decimalTables nmosDecimalTables = makeTables(true);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+// The results of ADC and SBC in decimal mode, computed at compile time.
+//
+// The tables are indexed by decimalIndex(carry, accumulator, operand).
+// Each entry holds the result in the low byte, and the new flags in
+// DECIMAL_C, DECIMAL_V, DECIMAL_N and DECIMAL_Z. Operands that are not
+// valid BCD give the same results as the real CPU does.
+//
+// On the 65C02 N and Z follow from the result. The NMOS 6502 derives N, V
+// and Z from intermediate results instead, and has tables of its own.
+typedef struct {
+    uint16_t adc[2*256*256];
+    uint16_t sbc[2*256*256];
+} t_decimalTables;
+
+const uint16_t DECIMAL_C = 0x100;
+const uint16_t DECIMAL_V = 0x200;
+const uint16_t DECIMAL_N = 0x400;
+const uint16_t DECIMAL_Z = 0x800;
+
+constexpr uint32_t decimalIndex(uint8_t carry, uint8_t areg, uint8_t arg)
+{
+    return (carry << 16) | (areg << 8) | arg;
+}
+
+extern const t_decimalTables decimalTables;      // 65C02
+extern const t_decimalTables nmosDecimalTables;  // NMOS 6502
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 // List of all the possible instructions.
 typedef enum
 {
@@ -11,7 +13,8 @@ typedef enum
     I_TXS, I_STY, I_LDY, I_CPY, I_INY, I_DEY, I_TAY, I_TYA, I_NOP, I_BRK, I_RES,
 
     // 65C02 instructions start here
-    I_PHX, I_PHY, I_PLX, I_PLY, I_BRA, I_BBR, I_BBS, I_INCA, I_DECA, I_STZ, I_TRB, I_TSB, I_RMB, I_SMB
+    I_PHX, I_PHY, I_PLX, I_PLY, I_BRA, I_BBR, I_BBS, I_INCA, I_DECA, I_STZ, I_TRB, I_TSB, I_RMB, I_SMB,
+    I_WAI, I_STP
 } instruction_t;
 
 // List of all the possible addressing modes.
@@ -59,7 +62,127 @@ typedef enum
     ALU_TSB
 } aluMode_t;
 
-extern const addrMode_t addrModes[256];
+// The decode tables of the WDC 65C02. They are constexpr, so that the
+// per-opcode handlers can be specialized at compile time. The other CPU
+// variants are derived from them (see variant.h).
+constexpr addrMode_t addrModes[256] = 
+{//   0x00     0x01     0x02     0x03     0x04     0x05     0x06     0x07      0x08     0x09     0x0A     0x0B     0x0C     0x0D     0x0E     0x0F
+    AM_IMM,  AM_INDX, AM_IMM,  AM_NONE,  AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_ACC,  AM_NONE, AM_ABS,  AM_ABS,  AM_ABS,  AM_ZR,  // 0x00
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_ZP,   AM_ZPX,  AM_ZPX,  AM_ZP,    AM_NONE, AM_ABSY, AM_ACC,  AM_NONE, AM_ABS,  AM_ABSX, AM_ABSX, AM_ZR,  // 0x10
+    AM_ABS,  AM_INDX, AM_IMM,  AM_NONE,  AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_ACC,  AM_NONE, AM_ABS,  AM_ABS,  AM_ABS,  AM_ZR,  // 0x20
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZP,    AM_NONE, AM_ABSY, AM_ACC,  AM_NONE, AM_ABSX, AM_ABSX, AM_ABSX, AM_ZR,  // 0x30
+    AM_NONE, AM_INDX, AM_IMM,  AM_NONE,  AM_IMM,  AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_ACC,  AM_NONE, AM_ABS,  AM_ABS,  AM_ABS,  AM_ZR,  // 0x40
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_IMM,  AM_ZPX,  AM_ZPX,  AM_ZP,    AM_NONE, AM_ABSY, AM_NONE, AM_NONE, AM_ABS,  AM_ABSX, AM_ABSX, AM_ZR,  // 0x50
+    AM_NONE, AM_INDX, AM_IMM,  AM_NONE,  AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_ACC,  AM_NONE, AM_IND,  AM_ABS,  AM_ABS,  AM_ZR,  // 0x60
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_ZPX,  AM_ZPX,  AM_ZPX,  AM_ZP,    AM_NONE, AM_ABSY, AM_NONE, AM_NONE, AM_IABSX,AM_ABSX, AM_ABSX, AM_ZR,  // 0x70
+    AM_REL,  AM_INDX, AM_IMM,  AM_NONE,  AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_NONE, AM_NONE, AM_ABS,  AM_ABS,  AM_ABS,  AM_ZR,  // 0x80
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_ZPX,  AM_ZPX,  AM_ZPY,  AM_ZP,    AM_NONE, AM_ABSY, AM_NONE, AM_NONE, AM_ABS,  AM_ABSX, AM_ABSX, AM_ZR,  // 0x90
+    AM_IMM,  AM_INDX, AM_IMM,  AM_NONE,  AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_NONE, AM_NONE, AM_ABS,  AM_ABS,  AM_ABS,  AM_ZR,  // 0xA0
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_ZPX,  AM_ZPX,  AM_ZPY,  AM_ZP,    AM_NONE, AM_ABSY, AM_NONE, AM_NONE, AM_ABSX, AM_ABSX, AM_ABSY, AM_ZR,  // 0xB0
+    AM_IMM,  AM_INDX, AM_IMM,  AM_NONE,  AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_NONE, AM_NONE, AM_ABS,  AM_ABS,  AM_ABS,  AM_ZR,  // 0xC0
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_IMM,  AM_ZPX,  AM_ZPX,  AM_ZP,    AM_NONE, AM_ABSY, AM_NONE, AM_NONE, AM_ABS,  AM_ABSX, AM_ABSX, AM_ZR,  // 0xD0
+    AM_IMM,  AM_INDX, AM_IMM,  AM_NONE,  AM_ZP,   AM_ZP,   AM_ZP,   AM_ZP,    AM_NONE, AM_IMM,  AM_NONE, AM_NONE, AM_ABS,  AM_ABS,  AM_ABS,  AM_ZR,  // 0xE0
+    AM_REL,  AM_INDY, AM_IZP,  AM_NONE,  AM_IMM,  AM_ZPX,  AM_ZPX,  AM_ZP,    AM_NONE, AM_ABSY, AM_NONE, AM_NONE, AM_ABS,  AM_ABSX, AM_ABSX, AM_ZR   // 0xF0
+}; // addrModes
+
+constexpr instruction_t instructions[256] = 
+{//  0x00   0x01   0x02   0x03   0x04   0x05   0x06   0x07    0x08   0x09   0x0A   0x0B   0x0C   0x0D   0x0E   0x0F
+    I_BRK, I_ORA, I_NOP, I_NOP, I_TSB, I_ORA, I_ASL, I_RMB,  I_PHP, I_ORA, I_ASLA,I_NOP, I_TSB, I_ORA, I_ASL, I_BBR, // 0x00
+    I_BPL, I_ORA, I_ORA, I_NOP, I_TRB, I_ORA, I_ASL, I_RMB,  I_CLC, I_ORA, I_INCA,I_NOP, I_TRB, I_ORA, I_ASL, I_BBR, // 0x10
+    I_JSR, I_AND, I_NOP, I_NOP, I_BIT, I_AND, I_ROL, I_RMB,  I_PLP, I_AND, I_ROLA,I_NOP, I_BIT, I_AND, I_ROL, I_BBR, // 0x20
+    I_BMI, I_AND, I_AND, I_NOP, I_BIT, I_AND, I_ROL, I_RMB,  I_SEC, I_AND, I_DECA,I_NOP, I_BIT, I_AND, I_ROL, I_BBR, // 0x30
+    I_RTI, I_EOR, I_NOP, I_NOP, I_NOP, I_EOR, I_LSR, I_RMB,  I_PHA, I_EOR, I_LSRA,I_NOP, I_JMP, I_EOR, I_LSR, I_BBR, // 0x40
+    I_BVC, I_EOR, I_EOR, I_NOP, I_NOP, I_EOR, I_LSR, I_RMB,  I_CLI, I_EOR, I_PHY, I_NOP, I_NOP, I_EOR, I_LSR, I_BBR, // 0x50
+    I_RTS, I_ADC, I_NOP, I_NOP, I_STZ, I_ADC, I_ROR, I_RMB,  I_PLA, I_ADC, I_RORA,I_NOP, I_JMP, I_ADC, I_ROR, I_BBR, // 0x60
+    I_BVS, I_ADC, I_ADC, I_NOP, I_STZ, I_ADC, I_ROR, I_RMB,  I_SEI, I_ADC, I_PLY, I_NOP, I_JMP, I_ADC, I_ROR, I_BBR, // 0x70
+    I_BRA, I_STA, I_NOP, I_NOP, I_STY, I_STA, I_STX, I_SMB,  I_DEY, I_BIT, I_TXA, I_NOP, I_STY, I_STA, I_STX, I_BBS, // 0x80
+    I_BCC, I_STA, I_STA, I_NOP, I_STY, I_STA, I_STX, I_SMB,  I_TYA, I_STA, I_TXS, I_NOP, I_STZ, I_STA, I_STZ, I_BBS, // 0x90
+    I_LDY, I_LDA, I_LDX, I_NOP, I_LDY, I_LDA, I_LDX, I_SMB,  I_TAY, I_LDA, I_TAX, I_NOP, I_LDY, I_LDA, I_LDX, I_BBS, // 0xA0
+    I_BCS, I_LDA, I_LDA, I_NOP, I_LDY, I_LDA, I_LDX, I_SMB,  I_CLV, I_LDA, I_TSX, I_NOP, I_LDY, I_LDA, I_LDX, I_BBS, // 0xB0
+    I_CPY, I_CMP, I_NOP, I_NOP, I_CPY, I_CMP, I_DEC, I_SMB,  I_INY, I_CMP, I_DEX, I_WAI, I_CPY, I_CMP, I_DEC, I_BBS, // 0xC0
+    I_BNE, I_CMP, I_CMP, I_NOP, I_NOP, I_CMP, I_DEC, I_SMB,  I_CLD, I_CMP, I_PHX, I_STP, I_NOP, I_CMP, I_DEC, I_BBS, // 0xD0
+    I_CPX, I_SBC, I_NOP, I_NOP, I_CPX, I_SBC, I_INC, I_SMB,  I_INX, I_SBC, I_NOP, I_NOP, I_CPX, I_SBC, I_INC, I_BBS, // 0xE0
+    I_BEQ, I_SBC, I_SBC, I_NOP, I_NOP, I_SBC, I_INC, I_SMB,  I_SED, I_SBC, I_PLX, I_NOP, I_NOP, I_SBC, I_INC, I_BBS  // 0xF0
+}; // instructions
+
+
+// Number of clock cycles for each opcode, without the penalties for
+// crossing a page or taking a branch.
+constexpr uint8_t cycles[256] =
+{// 0x00 0x01 0x02 0x03 0x04 0x05 0x06 0x07  0x08 0x09 0x0A 0x0B 0x0C 0x0D 0x0E 0x0F
+      7,   6,   2,   1,   5,   3,   5,   5,    3,   2,   2,   1,   6,   4,   6,   5,   // 0x00
+      2,   5,   5,   1,   5,   4,   6,   5,    2,   4,   2,   1,   6,   4,   6,   5,   // 0x10
+      6,   6,   2,   1,   3,   3,   5,   5,    4,   2,   2,   1,   4,   4,   6,   5,   // 0x20
+      2,   5,   5,   1,   4,   4,   6,   5,    2,   4,   2,   1,   4,   4,   6,   5,   // 0x30
+      6,   6,   2,   1,   3,   3,   5,   5,    3,   2,   2,   1,   3,   4,   6,   5,   // 0x40
+      2,   5,   5,   1,   4,   4,   6,   5,    2,   4,   3,   1,   8,   4,   6,   5,   // 0x50
+      6,   6,   2,   1,   3,   3,   5,   5,    4,   2,   2,   1,   6,   4,   6,   5,   // 0x60
+      2,   5,   5,   1,   4,   4,   6,   5,    2,   4,   4,   1,   6,   4,   6,   5,   // 0x70
+      3,   6,   2,   1,   3,   3,   3,   5,    2,   2,   2,   1,   4,   4,   4,   5,   // 0x80
+      2,   6,   5,   1,   4,   4,   4,   5,    2,   5,   2,   1,   4,   5,   5,   5,   // 0x90
+      2,   6,   2,   1,   3,   3,   3,   5,    2,   2,   2,   1,   4,   4,   4,   5,   // 0xA0
+      2,   5,   5,   1,   4,   4,   4,   5,    2,   4,   2,   1,   4,   4,   4,   5,   // 0xB0
+      2,   6,   2,   1,   3,   3,   5,   5,    2,   2,   2,   3,   4,   4,   6,   5,   // 0xC0
+      2,   5,   5,   1,   4,   4,   6,   5,    2,   4,   3,   3,   4,   4,   7,   5,   // 0xD0
+      2,   6,   2,   1,   3,   3,   5,   5,    2,   2,   2,   1,   4,   4,   6,   5,   // 0xE0
+      2,   5,   5,   1,   4,   4,   6,   5,    2,   4,   4,   1,   4,   4,   7,   5    // 0xF0
+}; // cycles
+
+// True if indexing across a page boundary costs an extra cycle. This is the
+// case for instructions that only read the operand, and with shifts (as on
+// the 65C02) also for the shifts and rotates.
+constexpr bool pagePenalty(addrMode_t addrMode, instruction_t instruction, bool shifts = true)
+{
+    return (addrMode == AM_ABSX || addrMode == AM_ABSY || addrMode == AM_INDY) &&
+           (instruction == I_ORA || instruction == I_AND || instruction == I_EOR ||
+            instruction == I_ADC || instruction == I_LDA || instruction == I_CMP ||
+            instruction == I_SBC || instruction == I_BIT || instruction == I_LDX ||
+            instruction == I_LDY ||
+            (shifts && addrMode == AM_ABSX && (instruction == I_ASL || instruction == I_ROL ||
+                                     instruction == I_LSR || instruction == I_ROR)));
+} // pagePenalty
 
-extern const instruction_t instructions[256];
+// True if the instruction can be the first of a fused pair (see fusion.h).
+// It must always continue with the next instruction, and neither write to
+// memory (which could change the second instruction) nor change the
+// interrupt mask.
+constexpr bool fusable(instruction_t instruction)
+{
+    return instruction == I_ORA || instruction == I_AND || instruction == I_EOR ||
+           instruction == I_ADC || instruction == I_LDA || instruction == I_CMP ||
+           instruction == I_SBC || instruction == I_BIT || instruction == I_LDX ||
+           instruction == I_LDY || instruction == I_CPX || instruction == I_CPY ||
+           instruction == I_CLC || instruction == I_SEC || instruction == I_CLV ||
+           instruction == I_CLD || instruction == I_SED || instruction == I_INX ||
+           instruction == I_DEX || instruction == I_INY || instruction == I_DEY ||
+           instruction == I_TAX || instruction == I_TXA || instruction == I_TAY ||
+           instruction == I_TYA || instruction == I_TSX || instruction == I_TXS ||
+           instruction == I_ASLA || instruction == I_ROLA || instruction == I_LSRA ||
+           instruction == I_RORA || instruction == I_INCA || instruction == I_DECA ||
+           instruction == I_PLA || instruction == I_PLX || instruction == I_PLY ||
+           instruction == I_NOP;
+} // fusable
 
+// True if the instruction ends a basic block, i.e. it can go somewhere else
+// than the next instruction, or stops the CPU.
+constexpr bool endsBlock(instruction_t instruction)
+{
+    return instruction == I_BPL || instruction == I_BMI || instruction == I_BVC ||
+           instruction == I_BVS || instruction == I_BCC || instruction == I_BCS ||
+           instruction == I_BNE || instruction == I_BEQ || instruction == I_BRA ||
+           instruction == I_BBR || instruction == I_BBS || instruction == I_JMP ||
+           instruction == I_JSR || instruction == I_RTS || instruction == I_RTI ||
+           instruction == I_BRK || instruction == I_RES || instruction == I_WAI ||
+           instruction == I_STP;
+} // endsBlock
+
+// True if the instruction can write to memory, and thereby modify code.
+constexpr bool writesMemory(instruction_t instruction)
+{
+    return instruction == I_STA || instruction == I_STX || instruction == I_STY ||
+           instruction == I_STZ || instruction == I_ASL || instruction == I_ROL ||
+           instruction == I_LSR || instruction == I_ROR || instruction == I_INC ||
+           instruction == I_DEC || instruction == I_TRB || instruction == I_TSB ||
+           instruction == I_RMB || instruction == I_SMB || instruction == I_PHA ||
+           instruction == I_PHP || instruction == I_PHX || instruction == I_PHY;
+} // writesMemory
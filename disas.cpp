@@ -0,0 +1,226 @@
+#include <cstring>
+#include "disas.h"
+#include "decode.h"
+
+// The names of the instructions, indexed by instruction_t.
+static constexpr char mnemonics[][4] = {
+    "RTI", "ORA", "AND", "EOR", "ADC", "STA", "LDA", "CMP", "SBC", "CLC",
+    "SEC", "CLI", "SEI", "CLV", "CLD", "SED", "BPL", "BMI", "BVC", "BVS",
+    "BCC", "BCS", "BNE", "BEQ", "JMP", "PHP", "JSR", "PLP", "PHA", "RTS",
+    "PLA", "ASL", "ROL", "LSR", "ROR", "ASL", "ROL", "LSR", "ROR", "DEC",
+    "INC", "BIT", "STX", "LDX", "CPX", "INX", "DEX", "TAX", "TXA", "TSX",
+    "TXS", "STY", "LDY", "CPY", "INY", "DEY", "TAY", "TYA", "NOP", "BRK", "???",
+
+    "PHX", "PHY", "PLX", "PLY", "BRA", "BBR", "BBS", "INC", "DEC", "STZ", "TRB", "TSB", "RMB", "SMB",
+    "WAI", "STP"
+};
+static_assert(sizeof(mnemonics) / sizeof(mnemonics[0]) == I_STP + 1, "One mnemonic for each instruction_t");
+
+// How the operand of each addressing mode is written, indexed by addrMode_t.
+typedef enum {OPERAND_NONE, OPERAND_BYTE, OPERAND_WORD, OPERAND_BRANCH, OPERAND_BIT} t_operand;
+typedef struct {
+    const char* prefix;
+    t_operand   operand;
+    const char* suffix;
+    uint8_t     length;     // Of the instruction.
+} t_format;
+
+static constexpr t_format formats[] = {
+    {" #$", OPERAND_BYTE,   "",    2},  // AM_IMM
+    {" $",  OPERAND_WORD,   "",    3},  // AM_ABS
+    {" $",  OPERAND_BYTE,   "",    2},  // AM_ZP
+    {"",    OPERAND_NONE,   "",    1},  // AM_NONE
+    {" A",  OPERAND_NONE,   "",    1},  // AM_ACC
+    {" $",  OPERAND_BYTE,   ",X",  2},  // AM_ZPX
+    {" $",  OPERAND_BYTE,   ",Y",  2},  // AM_ZPY
+    {" $",  OPERAND_WORD,   ",X",  3},  // AM_ABSX
+    {" $",  OPERAND_WORD,   ",Y",  3},  // AM_ABSY
+    {" ($", OPERAND_WORD,   ")",   3},  // AM_IND
+    {" ($", OPERAND_BYTE,   ",X)", 2},  // AM_INDX
+    {" ($", OPERAND_BYTE,   "),Y", 2},  // AM_INDY
+    {" $",  OPERAND_BRANCH, "",    2},  // AM_REL
+    {"",    OPERAND_NONE,   "",    1},  // AM_RES
+    {" ($", OPERAND_BYTE,   ")",   2},  // AM_IZP
+    {" ($", OPERAND_WORD,   ",X)", 3},  // AM_IABSX
+    {"",    OPERAND_BIT,    "",    3},  // AM_ZR, e.g. "BBR3 $12, c010"
+};
+static_assert(sizeof(formats) / sizeof(formats[0]) == AM_ZR + 1, "One format for each addrMode_t");
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static char* hex2(char* out, uint8_t value)
+{
+    out[0] = hexDigits[value >> 4];
+    out[1] = hexDigits[value & 0xF];
+    return out + 2;
+}
+
+static char* hex4(char* out, uint16_t value)
+{
+    return hex2(hex2(out, value >> 8), value & 0xFF);
+}
+
+static char* append(char* out, const char* text)
+{
+    while (*text)
+        *out++ = *text++;
+    return out;
+}
+
+static uint16_t sign_extend(uint8_t arg)
+{
+    return (arg < 0x80) ? arg : 0xFF00 | arg;
+}
+
+// The mnemonic and operand, e.g. "LDA #$f0".
+static char* instruction(char* out, uint16_t pc, const uint8_t bytes[3])
+{
+    uint8_t inst = bytes[0];
+    const t_format& format = formats[addrModes[inst]];
+
+    out = append(out, mnemonics[instructions[inst]]);
+    out = append(out, format.prefix);
+    switch (format.operand)
+    {
+        case OPERAND_NONE   : break;
+        case OPERAND_BYTE   : out = hex2(out, bytes[1]); break;
+        case OPERAND_WORD   : out = hex4(out, (bytes[2] << 8) | bytes[1]); break;
+        case OPERAND_BRANCH : out = hex4(out, pc + 2 + sign_extend(bytes[1])); break;
+        case OPERAND_BIT    : *out++ = '0' + ((inst >> 4) & 7);
+                              out = hex2(append(out, " $"), bytes[1]);
+                              out = hex4(append(out, ", "), pc + 3 + sign_extend(bytes[2]));
+                              break;
+    }
+    return append(out, format.suffix);
+} // instruction
+
+const char* mnemonic(uint8_t opcode)
+{
+    return mnemonics[instructions[opcode]];
+} // mnemonic
+
+uint8_t instructionLength(uint8_t opcode)
+{
+    return formats[addrModes[opcode]].length;
+} // instructionLength
+
+size_t disassemble(char* buf, uint16_t pc, const uint8_t bytes[3])
+{
+    char* out = append(hex2(buf, bytes[0]), " : ");
+    out = instruction(out, pc, bytes);
+    *out = 0;
+    return out - buf;
+} // disassemble
+
+void disassemble(std::ostream& os, uint16_t pc, const uint8_t bytes[3])
+{
+    char buf[DISASSEMBLY_SIZE];
+    os.write(buf, disassemble(buf, pc, bytes));
+} // disassemble
+
+// Indirect jumps can not be followed, and neither can returns, BRK (the
+// IRQ vector is an entry point anyway) and unimplemented opcodes.
+std::vector<uint8_t> findCode(const uint8_t image[65536], const std::vector<uint16_t>& entries)
+{
+    std::vector<uint8_t> code(65536, 0);
+    std::vector<uint16_t> todo(entries);
+    while (!todo.empty())
+    {
+        uint16_t pc = todo.back();
+        todo.pop_back();
+        while (!code[pc])
+        {
+            code[pc] = 1;
+            uint8_t bytes[3] = {image[pc], image[(uint16_t) (pc+1)], image[(uint16_t) (pc+2)]};
+            uint8_t length = instructionLength(bytes[0]);
+            uint16_t next = pc + length;
+
+            switch (addrModes[bytes[0]])
+            {
+                case AM_REL : todo.push_back(next + sign_extend(bytes[1])); break;
+                case AM_ZR  : todo.push_back(next + sign_extend(bytes[2])); break;
+                default     : break;
+            }
+
+            switch (instructions[bytes[0]])
+            {
+                case I_JSR :
+                    todo.push_back((bytes[2] << 8) | bytes[1]);
+                    break;
+                case I_JMP :
+                    if (addrModes[bytes[0]] == AM_ABS)
+                        todo.push_back((bytes[2] << 8) | bytes[1]);
+                    next = pc;      // Stop here.
+                    break;
+                case I_BRA :
+                case I_RTS :
+                case I_RTI :
+                case I_BRK :
+                case I_RES :
+                    next = pc;
+                    break;
+                default :
+                    break;
+            }
+            pc = next;
+        }
+    }
+    return code;
+} // findCode
+
+std::vector<uint16_t> entryPoints(const uint8_t image[65536])
+{
+    std::vector<uint16_t> entries;
+    for (uint16_t vector : {0xFFFC, 0xFFFA, 0xFFFE}) {
+        uint16_t entry = (image[vector+1] << 8) | image[vector];
+        if (entry != 0x0000 && entry != 0xFFFF)     // Not set.
+            entries.push_back(entry);
+    }
+    return entries;
+} // entryPoints
+
+void listing(std::ostream& os, const uint8_t image[65536], const Symbols& symbols,
+        const std::vector<uint16_t>& entries)
+{
+    std::vector<uint16_t> all = entryPoints(image);
+    all.insert(all.end(), entries.begin(), entries.end());
+    std::vector<uint8_t> code = findCode(image, all);
+
+    // The text is put together in a buffer, which is written out whenever
+    // it is nearly full.
+    static const size_t bufferSize = 1 << 16;
+    static const size_t maxLine    = 256;
+    std::vector<char> buffer(bufferSize);
+    char* out = buffer.data();
+
+    unsigned expected = 0x10000;    // Where the previous instruction ends.
+    for (unsigned pc = 0; pc < 0x10000; ++pc)
+    {
+        if (!code[pc])
+            continue;
+
+        if (pc != expected && expected != 0x10000)
+            *out++ = '\n';
+        std::string label = symbols.exact(pc);
+        if (!label.empty() && label.size() < maxLine - 2) {
+            out = append(out, label.c_str());
+            out = append(out, ":\n");
+        }
+
+        uint8_t bytes[3] = {image[pc], image[(pc+1) & 0xFFFF], image[(pc+2) & 0xFFFF]};
+        uint8_t length = instructionLength(bytes[0]);
+        out = append(hex4(out, pc), "  ");
+        for (uint8_t i = 0; i < 3; ++i)
+            out = (i < length) ? append(hex2(out, bytes[i]), " ") : append(out, "   ");
+        out = append(out, "  ");
+        out = instruction(out, pc, bytes);
+        *out++ = '\n';
+        expected = pc + length;
+
+        if (out - buffer.data() > (ptrdiff_t) (bufferSize - 2*maxLine)) {
+            os.write(buffer.data(), out - buffer.data());
+            out = buffer.data();
+        }
+    }
+    os.write(buffer.data(), out - buffer.data());
+} // listing
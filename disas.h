@@ -0,0 +1,39 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+#include <stdint.h>
+#include "symbols.h"
+
+// Room needed for the text of one instruction, including the terminating zero.
+const size_t DISASSEMBLY_SIZE = 24;
+
+// Disassemble a single instruction located at pc. The bytes are the opcode
+// followed by the next two bytes in memory (whether used or not).
+// The output is e.g. "a9 : LDA #$f0", without a newline.
+void disassemble(std::ostream& os, uint16_t pc, const uint8_t bytes[3]);
+
+// The same into buf, which must have room for DISASSEMBLY_SIZE characters.
+// Returns the length. Nothing is allocated.
+size_t disassemble(char* buf, uint16_t pc, const uint8_t bytes[3]);
+
+// The name of the instruction, e.g. "LDA" for 0xA9.
+const char* mnemonic(uint8_t opcode);
+
+// The number of bytes of the instruction.
+uint8_t instructionLength(uint8_t opcode);
+
+// Find the instructions in a 64 KB image that can be reached from the
+// entry points, by following branches, jumps and calls. Returns a flag for
+// each address, set where an instruction starts.
+std::vector<uint8_t> findCode(const uint8_t image[65536], const std::vector<uint16_t>& entries);
+
+// The reset, NMI and IRQ entry points of a 64 KB image. Vectors that are
+// not set (0000 or ffff) are left out.
+std::vector<uint16_t> entryPoints(const uint8_t image[65536]);
+
+// Write a listing of the code reachable from the reset, NMI and IRQ vectors
+// and the extra entry points, with the labels from the symbols, e.g.
+// "c000  a9 f0     LDA #$f0". Stretches of data are left out.
+void listing(std::ostream& os, const uint8_t image[65536], const Symbols& symbols,
+        const std::vector<uint16_t>& entries = std::vector<uint16_t>());
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "cpu65c02.h"
+#include "decimal.h"
+#include "decode.h"
+#include "variant.h"
+
+// The semantics of the instructions. They are included by the interpreter,
+// and by the code romcc generates from a ROM (see aot.h), so that both get
+// them inlined and specialized.
+
+// Performs an ALU operation, and records what the flags are derived from.
+inline __attribute__((always_inline))
+uint8_t Cpu65C02::alu(uint8_t op, uint8_t arg1, uint8_t arg2)
+{
+    uint16_t tmp16;
+    uint8_t  tmp8 = arg1;
+
+    switch (op)
+    {
+        case ALU_ORA:
+            tmp8 = arg1 | arg2;
+            break;
+        case ALU_AND:
+            tmp8 = arg1 & arg2;
+            break;
+        case ALU_EOR:
+            tmp8 = arg1 ^ arg2;
+            break;
+        case ALU_ADC:
+            tmp16 = arg1 + arg2 + m_carry;
+            // Set C and V
+            tmp8       = tmp16 & 0xFF;
+            m_carry    = tmp16 >> 8;
+            m_overflow = ~(arg1 ^ arg2) & (arg1 ^ tmp8);
+            break;
+        case ALU_LDA:
+            tmp8 = arg2;
+            break;
+        case ALU_CMP:
+            tmp16 = arg1 + ((~arg2) & 0xFF) + 1;
+            // Set C
+            tmp8    = tmp16 & 0xFF;
+            m_carry = tmp16 >> 8;
+            break;
+        case ALU_SBC:
+            tmp16 = arg1 + ((~arg2) & 0xFF) + m_carry;
+            // Set C and V
+            tmp8       = tmp16 & 0xFF;
+            m_carry    = tmp16 >> 8;
+            m_overflow = (arg1 ^ arg2) & (arg1 ^ tmp8);
+            break;
+        case ALU_ASL:
+            tmp8    = arg2 << 1;
+            m_carry = arg2 >> 7;
+            break;
+        case ALU_ROL:
+            tmp8    = (arg2 << 1) | m_carry;
+            m_carry = arg2 >> 7;
+            break;
+        case ALU_LSR:
+            tmp8    = arg2 >> 1;
+            m_carry = arg2 & 1;
+            break;
+        case ALU_ROR:
+            tmp8    = (arg2 >> 1) | (m_carry << 7);
+            m_carry = arg2 & 1;
+            break;
+        case ALU_DEC:
+            tmp8 = arg2 - 1;
+            break;
+        case ALU_INC:
+            tmp8 = arg2 + 1;
+            break;
+        case ALU_BIT:
+            // Set S, Z, and V
+            m_sign     = arg2;
+            m_overflow = arg2 << 1;
+            m_zero     = arg1 & arg2;
+            return arg1 & arg2;
+        case ALU_TRB:
+            // Set Z
+            m_zero = arg1 & arg2;
+            return arg2 & (~arg1);
+        case ALU_TSB:
+            // Set Z
+            m_zero = arg1 & arg2;
+            return arg2 | arg1;
+    }
+
+    // Set S and Z
+    m_sign = tmp8;
+    m_zero = tmp8;
+    return tmp8;
+} // alu
+
+// Executes a decoded instruction. This is always inlined, so that each
+// per-opcode handler gets its own copy with the switches resolved, and the
+// differences between the variants too.
+template <class VARIANT>
+inline __attribute__((always_inline))
+void Cpu65C02::execute(const t_decoded& d, uint8_t addrMode, uint8_t instruction, uint8_t cycles)
+{
+    uint8_t inst = d.opcode;
+    uint16_t pArg = 0;
+    uint8_t pArgBit = 0;
+    uint8_t pArgZp = 0;
+    uint16_t pBase = 0;     // Address before indexing.
+
+    // Get pointer to operand in memory.
+    switch (addrMode)
+    {
+        case AM_IMM  : pArg = m_pc+1; break;
+        case AM_ABS  : pArg = d.operand; break;
+        case AM_ZP   : pArg = d.operand; break;
+        case AM_NONE : break;
+        case AM_ACC  : break;
+        case AM_ZPX  : pArg = (d.operand + m_xreg) & 0xFF; break;
+        case AM_ZPY  : pArg = (d.operand + m_yreg) & 0xFF; break;
+        case AM_ABSX : pArg = d.operand + m_xreg; pBase = d.operand; break;
+        case AM_ABSY : pArg = d.operand + m_yreg; pBase = d.operand; break;
+        case AM_IND  : if (VARIANT::indirectPageWrap)
+                           pArg = m_memory.read(d.operand) | (m_memory.read((d.operand & 0xFF00) | ((d.operand + 1) & 0xFF)) << 8);
+                       else
+                           pArg = read16(d.operand);
+                       break;
+        case AM_INDX : pArg = read16((d.operand + m_xreg) & 0xFF); break;
+        case AM_INDY : pBase = read16(d.operand); pArg = pBase + m_yreg; break;
+        case AM_REL  : pArg = d.operand; break;
+        case AM_RES  : m_stop |= STOP_ILLEGAL; return;
+
+        case AM_IZP  : pArg = read16(d.operand); break;
+        case AM_IABSX: pArg = read16(d.operand + m_xreg); break;
+        case AM_ZR   : pArgBit = d.bit;
+                       pArgZp  = d.zp;
+                       pArg = d.operand; break;
+    } // switch (addrMode)
+    m_pc += d.length;
+
+    addCycles(cycles);
+    if (pagePenalty((addrMode_t) addrMode, (instruction_t) instruction, VARIANT::shiftPagePenalty))
+        addCycles((pBase ^ pArg) > 0xFF);
+
+    // Execute instruction.
+    switch (instruction)
+    {
+        case I_RES: m_pc -= d.length; m_stop |= STOP_ILLEGAL; break;
+
+        case I_ORA: m_areg = alu(ALU_ORA, m_areg, m_memory.read(pArg)); break;
+        case I_AND: m_areg = alu(ALU_AND, m_areg, m_memory.read(pArg)); break;
+        case I_EOR: m_areg = alu(ALU_EOR, m_areg, m_memory.read(pArg)); break;
+        case I_ADC: if (__builtin_expect(m_status & FLAG_D, 0))
+                        m_areg = decimal(VARIANT::decimal.adc, m_memory.read(pArg), VARIANT::decimalCycles);
+                    else
+                        m_areg = alu(ALU_ADC, m_areg, m_memory.read(pArg));
+                    break;
+        case I_STA: m_memory.write(pArg, m_areg); break;
+        case I_LDA: m_areg = alu(ALU_LDA, m_areg, m_memory.read(pArg)); break;
+        case I_CMP:          alu(ALU_CMP, m_areg, m_memory.read(pArg)); break;
+        case I_SBC: if (__builtin_expect(m_status & FLAG_D, 0))
+                        m_areg = decimal(VARIANT::decimal.sbc, m_memory.read(pArg), VARIANT::decimalCycles);
+                    else
+                        m_areg = alu(ALU_SBC, m_areg, m_memory.read(pArg));
+                    break;
+        case I_STZ: m_memory.write(pArg, 0); break;
+
+        case I_CLC: m_carry     = 0; break;
+        case I_SEC: m_carry     = 1; break;
+        case I_CLI: m_status   &= ~FLAG_I; if (m_irqLines) pollInterrupts(); break;
+        case I_SEI: m_status   |= FLAG_I; break;
+        case I_CLV: m_overflow  = 0; break;
+        case I_CLD: m_status   &= ~FLAG_D; break;
+        case I_SED: m_status   |= FLAG_D; break;
+
+        case I_BPL: if (!(m_sign & 0x80))     branch(pArg); break;
+        case I_BMI: if (m_sign & 0x80)        branch(pArg); break;
+        case I_BVC: if (!(m_overflow & 0x80)) branch(pArg); break;
+        case I_BVS: if (m_overflow & 0x80)    branch(pArg); break;
+        case I_BCC: if (!m_carry)             branch(pArg); break;
+        case I_BCS: if (m_carry)              branch(pArg); break;
+        case I_BNE: if (m_zero)               branch(pArg); break;
+        case I_BEQ: if (!m_zero)              branch(pArg); break;
+        case I_BRA: addCycles((m_pc ^ pArg) > 0xFF); m_pc = pArg; break;
+
+        case I_BBR: if ((~m_memory.read(pArgZp)) & (1 << pArgBit)) branch(pArg); break;
+        case I_BBS: if (  m_memory.read(pArgZp)  & (1 << pArgBit)) branch(pArg); break;
+        case I_TRB: m_memory.write(pArg, alu(ALU_TRB, m_areg, m_memory.read(pArg))); break;
+        case I_TSB: m_memory.write(pArg, alu(ALU_TSB, m_areg, m_memory.read(pArg))); break;
+        case I_RMB: m_memory.write(pArg, m_memory.read(pArg) & ~(1 << ((inst >> 4) & 7))); break;
+        case I_SMB: m_memory.write(pArg, m_memory.read(pArg) |  (1 << ((inst >> 4) & 7))); break;
+
+        case I_PHP: m_memory.write(0x0100 | m_sp, 0x30 | flags()); m_sp -= 1; break;
+        case I_JSR: m_memory.write(0x0100 | m_sp, (m_pc-1) >> 8); m_memory.write(0x0100 | (m_sp-1), (m_pc-1) & 0xFF); m_sp -= 2; m_pc = pArg; break;
+        case I_PLP: m_sp += 1; setFlags(m_memory.read(0x0100 | m_sp)); if (m_irqLines) pollInterrupts(); break;
+        case I_PHA: m_memory.write(0x0100 | m_sp, m_areg); m_sp -= 1; break;
+        case I_RTS: m_sp += 2; m_pc = read16(0x0100 | (m_sp-1)) + 1; break; 
+        case I_PLA: m_sp += 1; m_areg = alu(ALU_LDA, m_areg, m_memory.read(0x0100 | m_sp)); break;
+
+        case I_PHX: m_memory.write(0x0100 | m_sp, m_xreg); m_sp -= 1; break;
+        case I_PLX: m_sp += 1; m_xreg = alu(ALU_LDA, m_xreg, m_memory.read(0x0100 | m_sp)); break;
+        case I_PHY: m_memory.write(0x0100 | m_sp, m_yreg); m_sp -= 1; break;
+        case I_PLY: m_sp += 1; m_yreg = alu(ALU_LDA, m_yreg, m_memory.read(0x0100 | m_sp)); break;
+
+        case I_INCA: m_areg = alu(ALU_INC, 0, m_areg); break;
+        case I_DECA: m_areg = alu(ALU_DEC, 0, m_areg); break;
+        case I_ASLA: m_areg = alu(ALU_ASL, 0, m_areg); break;
+        case I_ROLA: m_areg = alu(ALU_ROL, 0, m_areg); break;
+        case I_LSRA: m_areg = alu(ALU_LSR, 0, m_areg); break;
+        case I_RORA: m_areg = alu(ALU_ROR, 0, m_areg); break;
+        case I_ASL: m_memory.write(pArg, alu(ALU_ASL, 0, m_memory.read(pArg))); break;
+        case I_ROL: m_memory.write(pArg, alu(ALU_ROL, 0, m_memory.read(pArg))); break;
+        case I_LSR: m_memory.write(pArg, alu(ALU_LSR, 0, m_memory.read(pArg))); break;
+        case I_ROR: m_memory.write(pArg, alu(ALU_ROR, 0, m_memory.read(pArg))); break;
+        case I_DEC: m_memory.write(pArg, alu(ALU_DEC, 0, m_memory.read(pArg))); break;
+        case I_INC: m_memory.write(pArg, alu(ALU_INC, 0, m_memory.read(pArg))); break;
+        case I_BIT: if (addrMode == AM_IMM)
+                       m_zero = m_areg & m_memory.read(pArg);   // Only Z is affected.
+                    else
+                       alu(ALU_BIT, m_areg, m_memory.read(pArg));
+                    break;
+
+        case I_STX: m_memory.write(pArg, m_xreg); break;
+        case I_LDX: m_xreg = alu(ALU_LDA, 0, m_memory.read(pArg)); break;
+        case I_CPX:          alu(ALU_CMP, m_xreg, m_memory.read(pArg)); break;
+        case I_INX: m_xreg = alu(ALU_INC, 0, m_xreg); break;
+        case I_DEX: m_xreg = alu(ALU_DEC, 0, m_xreg); break;
+        case I_TAX: m_xreg = alu(ALU_LDA, 0, m_areg); break;
+        case I_TXA: m_areg = alu(ALU_LDA, 0, m_xreg); break;
+        case I_TSX: m_xreg = alu(ALU_LDA, 0, m_sp); break;
+        case I_TXS: m_sp = m_xreg; break;
+
+        case I_STY: m_memory.write(pArg, m_yreg); break;
+        case I_LDY: m_yreg = alu(ALU_LDA, 0, m_memory.read(pArg)); break;
+        case I_CPY:          alu(ALU_CMP, m_yreg, m_memory.read(pArg)); break;
+        case I_INY: m_yreg = alu(ALU_INC, 0, m_yreg); break;
+        case I_DEY: m_yreg = alu(ALU_DEC, 0, m_yreg); break;
+        case I_TAY: m_yreg = alu(ALU_LDA, 0, m_areg); break;
+        case I_TYA: m_areg = alu(ALU_LDA, 0, m_yreg); break;
+
+        case I_NOP: break;
+        case I_BRK: m_memory.write(0x0100 | m_sp, m_pc >> 8); m_memory.write(0x0100 | (m_sp-1), m_pc & 0xFF); m_sp -= 2;
+                    m_memory.write(0x0100 | m_sp, 0x30 | flags()); m_sp -= 1;
+                    m_status |= FLAG_I;
+                    if (VARIANT::interruptClearsDecimal)
+                        m_status &= ~FLAG_D;
+                    m_pc = read16(0xFFFE);
+                    m_stop |= STOP_BRK;
+                    break;
+        case I_RTI: m_sp += 1; setFlags(m_memory.read(0x0100 | m_sp));
+                    m_sp += 2; m_pc = read16(0x0100 | (m_sp-1));
+                    if (m_irqLines)
+                        pollInterrupts();
+                    break; 
+
+        case I_JMP: m_pc = pArg; break;
+
+        case I_WAI:
+            // An interrupt already asserted ends the wait at once.
+            if (!m_irqLines && !m_nmi)
+                m_waiting = true;
+            else
+                pollInterrupts();
+            break;
+        case I_STP: m_pc -= d.length; m_stop |= STOP_STP; break;
+    } // switch (instruction)
+} // execute
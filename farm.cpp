@@ -0,0 +1,98 @@
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "farm.h"
+
+namespace {
+
+// Job numbers waiting to be run by one thread.
+typedef struct {
+    std::mutex         mutex;
+    std::deque<size_t> jobs;
+} t_queue;
+
+// Take a job from our own queue, or else steal one from another thread.
+bool takeJob(std::vector<t_queue>& queues, unsigned self, size_t& job)
+{
+    for (unsigned i = 0; i < queues.size(); ++i)
+    {
+        t_queue& queue = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            continue;
+
+        if (i == 0) {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        } else {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+        return true;
+    }
+    return false;
+} // takeJob
+
+void runJob(const Farm::t_job& job, Farm::t_result& result)
+{
+    Memory mem(job.image ? std::vector<uint8_t>() : *job.rom);
+    if (job.image)
+        job.image->install(mem);
+    Cpu65C02 cpu(mem, job.variant);
+    if (job.start)
+        job.start->restore(cpu, mem);
+    if (job.useEntry)
+        cpu.setRegisters(job.entry);
+
+    // A snapshot brings its own instruction count.
+    uint64_t startCount = cpu.instructionCount();
+    result.reason       = cpu.run(job.budget, job.stopMask);
+    result.registers    = cpu.getRegisters();
+    result.instructions = cpu.instructionCount() - startCount;
+} // runJob
+
+} // namespace
+
+Farm::Farm(unsigned threads) : m_threads(threads), m_instructions(0), m_seconds(0)
+{
+    if (m_threads == 0)
+        m_threads = std::thread::hardware_concurrency();
+    if (m_threads == 0)
+        m_threads = 1;
+} // Farm
+
+std::vector<Farm::t_result> Farm::run(const std::vector<t_job>& jobs)
+{
+    std::vector<t_result> results(jobs.size());
+
+    unsigned threads = m_threads;
+    if (threads > jobs.size())
+        threads = jobs.size() ? jobs.size() : 1;
+
+    std::vector<t_queue> queues(threads);
+    for (size_t i = 0; i < jobs.size(); ++i)
+        queues[i % threads].jobs.push_back(i);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            size_t job;
+            while (takeJob(queues, t, job))
+                runJob(jobs[job], results[job]);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_instructions = 0;
+    for (const t_result& result : results)
+        m_instructions += result.instructions;
+
+    return results;
+} // run
+
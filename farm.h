@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include "cpu65c02.h"
+#include "image.h"
+#include "snapshot.h"
+
+// Runs a large number of independent programs on all cores.
+//
+// Each job gets its own Memory and Cpu65C02, so nothing is shared between
+// the threads, except the pages of a read-only RomImage. The jobs are
+// dealt out round-robin to one queue per thread. A thread takes jobs from
+// the back of its own queue, and when that is empty it steals from the
+// front of the other queues.
+class Farm
+{
+    public:
+        typedef struct {
+            const std::vector<uint8_t>* rom;    // Loaded at the top of memory.
+            const RomImage* image;  // If not null, installed as ROM instead, and shared.
+            bool     useEntry;      // Start from entry instead of the reset vector.
+            Cpu65C02::t_registers entry;
+            const Snapshot* start;  // If not null, start from here instead.
+            uint64_t budget;        // Maximum number of instructions.
+            uint32_t stopMask;
+            Cpu65C02::t_variant variant;
+        } t_job;
+
+        typedef struct {
+            Cpu65C02::t_registers registers;    // When the job stopped.
+            Cpu65C02::t_stopReason reason;
+            uint64_t instructions;
+        } t_result;
+
+        // Zero threads means one per core.
+        Farm(unsigned threads = 0);
+
+        // Runs all the jobs, and returns the results in the same order.
+        std::vector<t_result> run(const std::vector<t_job>& jobs);
+
+        // Statistics of the last call to run().
+        uint64_t instructions() const {return m_instructions;}
+        double   seconds() const      {return m_seconds;}
+        double   instructionsPerSecond() const {return m_seconds > 0 ? m_instructions / m_seconds : 0;}
+
+    private:
+        unsigned m_threads;
+        uint64_t m_instructions;
+        double   m_seconds;
+}; // end of class Farm
+
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// The instruction pairs that the interpreter executes with one dispatch,
+// as the opcodes of the first and the second instruction. The first one
+// must be fusable() (see decode.h).
+//
+// Regenerate with "make fusion", which profiles rom.bin and takes the
+// pairs executed most often.
+static constexpr uint8_t fusedPairs[][2] = {
+    {0xc9, 0xd0},   // CMP imm, BNE rel
+    {0xc9, 0xf0},   // CMP imm, BEQ rel
+    {0xca, 0xd0},   // DEX impl, BNE rel
+    {0x88, 0xd0},   // DEY impl, BNE rel
+    {0xe8, 0xd0},   // INX impl, BNE rel
+    {0xc8, 0xd0},   // INY impl, BNE rel
+    {0xc8, 0xc0},   // INY impl, CPY imm
+    {0xc0, 0xd0},   // CPY imm, BNE rel
+    {0xe0, 0xd0},   // CPX imm, BNE rel
+    {0xcd, 0xd0},   // CMP abs, BNE rel
+    {0xc5, 0xd0},   // CMP zp, BNE rel
+    {0xa9, 0x8d},   // LDA imm, STA abs
+    {0xa9, 0x85},   // LDA imm, STA zp
+    {0xa5, 0x85},   // LDA zp, STA zp
+    {0xad, 0x8d},   // LDA abs, STA abs
+    {0xbd, 0x9d},   // LDA abs,X, STA abs,X
+};
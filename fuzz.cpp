@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include "fuzz.h"
+
+Fuzzer::t_config Fuzzer::defaultConfig()
+{
+    t_config config;
+    config.entry      = 0;
+    config.bootBudget = 100000000;
+    config.inputAddr  = 0x0200;
+    config.inputSize  = 256;
+    config.lengthAddr = -1;
+    config.done       = -1;
+    config.budget     = 100000;
+    config.crashMask  = Cpu65C02::STOP_ILLEGAL | Cpu65C02::STOP_WATCHPOINT;
+    return config;
+} // defaultConfig
+
+bool Fuzzer::parse(const std::string& option, t_config& config)
+{
+    size_t equals = option.find('=');
+    if (equals == std::string::npos)
+        return false;
+    std::string name = option.substr(0, equals);
+    const char* value = option.c_str() + equals + 1;
+    uint32_t hex = strtoul(value, 0, 16);
+    uint64_t dec = strtoull(value, 0, 10);
+
+    if (name == "entry")
+        config.entry = hex;
+    else if (name == "input")
+        config.inputAddr = hex;
+    else if (name == "length")
+        config.lengthAddr = hex & 0xFFFF;
+    else if (name == "done")
+        config.done = hex & 0xFFFF;
+    else if (name == "size" && dec > 0 && dec < 65536)
+        config.inputSize = dec;
+    else if (name == "budget")
+        config.budget = dec;
+    else if (name == "boot")
+        config.bootBudget = dec;
+    else if (name == "brk")
+        config.crashMask = dec ? (config.crashMask | Cpu65C02::STOP_BRK) : (config.crashMask & ~Cpu65C02::STOP_BRK);
+    else
+        return false;
+    return true;
+} // parse
+
+Fuzzer::Fuzzer(Cpu65C02& cpu, Memory& memory, Coverage& coverage, const t_config& config) :
+    m_cpu(cpu), m_memory(memory), m_coverage(coverage), m_config(config), m_reason(Cpu65C02::STOP_BUDGET),
+    m_runs(0), m_hangs(0), m_random(1)
+{
+} // Fuzzer
+
+Fuzzer::~Fuzzer()
+{
+    m_cpu.setCoverage(0);
+    if (m_config.done >= 0)
+        m_cpu.setBreakpoint(m_config.done, false);
+} // ~Fuzzer
+
+bool Fuzzer::boot()
+{
+    if (m_cpu.getRegisters().pc != m_config.entry) {
+        m_cpu.setBreakpoint(m_config.entry, true);
+        Cpu65C02::t_stopReason reason = m_cpu.run(m_config.bootBudget, Cpu65C02::STOP_BREAKPOINT | Cpu65C02::STOP_ILLEGAL);
+        m_cpu.setBreakpoint(m_config.entry, false);
+        if (reason != Cpu65C02::STOP_BREAKPOINT)
+            return false;
+    }
+
+    m_start.save(m_cpu, m_memory);
+    if (m_config.done >= 0)
+        m_cpu.setBreakpoint(m_config.done, true);
+    m_cpu.setCoverage(&m_coverage);
+    return true;
+} // boot
+
+Fuzzer::t_outcome Fuzzer::run(const uint8_t* data, size_t size)
+{
+    m_start.restore(m_cpu, m_memory);
+    size = std::min<size_t>(size, m_config.inputSize);
+    m_memory.load(m_config.inputAddr, data, size);
+    if (m_config.lengthAddr >= 0) {
+        uint8_t length[2] = {(uint8_t) size, (uint8_t) (size >> 8)};
+        m_memory.load(m_config.lengthAddr, length, (m_config.inputSize > 255) ? 2 : 1);
+    }
+
+    // A jump to itself is where a program without a return address to
+    // give ends up, so that is done too.
+    m_reason = m_cpu.run(m_config.budget, m_config.crashMask | Cpu65C02::STOP_BREAKPOINT | Cpu65C02::STOP_SELF_JUMP);
+    m_runs += 1;
+    if (m_reason & m_config.crashMask)
+        return RUN_CRASH;
+    if (m_reason == Cpu65C02::STOP_BUDGET) {
+        m_hangs += 1;
+        return RUN_HANG;
+    }
+    return RUN_DONE;
+} // run
+
+// xorshift32
+uint32_t Fuzzer::random()
+{
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return m_random;
+} // random
+
+// One to four changes to the input.
+void Fuzzer::mutate(std::vector<uint8_t>& input)
+{
+    static const uint8_t interesting[] = {0x00, 0x01, 0x0A, 0x0D, 0x20, 0x30, 0x39, 0x41, 0x7F, 0x80, 0xFE, 0xFF};
+
+    for (unsigned count = 1 + random() % 4; count > 0; --count)
+    {
+        size_t size = input.size();
+        switch (random() % 6)
+        {
+            case 0 :    // Flip a bit.
+                if (size)
+                    input[random() % size] ^= 1 << (random() % 8);
+                break;
+            case 1 :    // A random byte.
+                if (size)
+                    input[random() % size] = random();
+                break;
+            case 2 :    // A byte that is often treated specially.
+                if (size)
+                    input[random() % size] = interesting[random() % sizeof(interesting)];
+                break;
+            case 3 :    // Insert a byte.
+                if (size < m_config.inputSize)
+                    input.insert(input.begin() + random() % (size + 1), (uint8_t) random());
+                break;
+            case 4 :    // Remove a byte.
+                if (size > 1)
+                    input.erase(input.begin() + random() % size);
+                break;
+            case 5 :    // Copy a piece of another input over it.
+            {
+                const std::vector<uint8_t>& other = m_corpus[random() % m_corpus.size()];
+                if (size == 0 || other.empty())
+                    break;
+                size_t from = random() % other.size();
+                size_t to   = random() % size;
+                size_t length = std::min(other.size() - from, size - to);
+                length = 1 + random() % length;
+                std::copy(other.begin() + from, other.begin() + from + length, input.begin() + to);
+                break;
+            }
+        }
+    }
+} // mutate
+
+// The class of each hit count: 1, 2, 3, 4-7, 8-15, 16-31, 32-127 or
+// 128-255, as in AFL.
+static std::array<uint8_t, 256> hitClasses()
+{
+    static const uint8_t limits[] = {1, 2, 3, 7, 15, 31, 127, 255};
+    std::array<uint8_t, 256> classes = {};
+    for (unsigned count = 1, bit = 0; count < 256; ++count)
+    {
+        while (count > limits[bit])
+            bit += 1;
+        classes[count] = 1 << bit;
+    }
+    return classes;
+} // hitClasses
+
+// True if a counter has a hit count class not seen before. The map is
+// cleared for the next run meanwhile.
+bool Fuzzer::takeCoverage(std::vector<uint8_t>& virgin)
+{
+    static const std::array<uint8_t, 256> classes = hitClasses();
+
+    // Most of the map is zero, so it is scanned 32 counters at a time.
+    uint8_t* map = m_coverage.map();
+    bool found = false;
+    for (size_t i = 0; i < m_coverage.size(); i += 32)
+    {
+        uint64_t words[4];
+        memcpy(words, map + i, 32);
+        if ((words[0] | words[1] | words[2] | words[3]) == 0)
+            continue;
+        for (size_t j = i; j < i + 32; ++j)
+        {
+            uint8_t bits = classes[map[j]];
+            if (bits & ~virgin[j]) {
+                virgin[j] |= bits;
+                found = true;
+            }
+        }
+        memset(map + i, 0, 32);
+    }
+    return found;
+} // takeCoverage
+
+void Fuzzer::fuzz(uint64_t runs, uint32_t seed)
+{
+    m_random = seed ? seed : 1;
+    if (m_corpus.empty())
+        m_corpus.push_back(std::vector<uint8_t>(1, 0));
+    m_virgin.assign(m_coverage.size(), 0);
+    m_virginCrash.assign(m_coverage.size(), 0);
+    m_coverage.clear();
+
+    // The coverage of the inputs given.
+    for (size_t i = 0; i < m_corpus.size(); ++i)
+    {
+        run(m_corpus[i].data(), m_corpus[i].size());
+        takeCoverage(m_virgin);
+    }
+
+    std::vector<uint8_t> input;
+    for (uint64_t i = 0; i < runs; ++i)
+    {
+        input = m_corpus[random() % m_corpus.size()];
+        mutate(input);
+        t_outcome outcome = run(input.data(), input.size());
+
+        // Crashes are only kept when they go somewhere new, so that the
+        // same crash is not reported over and over. Hangs are not kept.
+        if (outcome == RUN_HANG)
+            m_coverage.clear();
+        else if (outcome == RUN_CRASH && takeCoverage(m_virginCrash))
+            m_crashes.push_back(input);
+        else if (outcome == RUN_DONE && takeCoverage(m_virgin))
+            m_corpus.push_back(input);
+    }
+} // fuzz
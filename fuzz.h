@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "coverage.h"
+#include "cpu65c02.h"
+#include "snapshot.h"
+
+// Runs a firmware routine over and over with different input, for
+// coverage-guided fuzzing, all in one process.
+//
+// The program is booted once, up to the entry of the routine, and that
+// state is kept as a Snapshot. Each run restores it, which only copies the
+// pages written by the previous run, copies the input into RAM, and runs
+// until the routine is done, a crash, or the budget is used up. The
+// coverage of the guest program is recorded meanwhile (see coverage.h).
+//
+// run() is what libFuzzer and AFL++ call (see fuzztarget.cpp). fuzz() is a
+// small mutational fuzzer of its own, for "cpu65c02 -fuzz".
+class Fuzzer
+{
+    public:
+        typedef struct {
+            uint16_t entry;         // Runs start from the state when the PC first gets here.
+            uint64_t bootBudget;    // Most instructions from reset to entry.
+            uint16_t inputAddr;     // Where the input is copied to.
+            uint16_t inputSize;     // Longer inputs are cut short.
+            int32_t  lengthAddr;    // If not negative, the length is stored here, low byte first.
+                                    // Two bytes if inputSize is more than 255.
+            int32_t  done;          // If not negative, a run ends when the PC gets here.
+            uint64_t budget;        // Most instructions per run. Running out is a hang.
+            uint32_t crashMask;     // Stop reasons that are crashes.
+        } t_config;
+
+        static t_config defaultConfig();
+
+        // Parses "name=value", with addresses in hex: entry, input, length,
+        // done, and in decimal: size, budget, boot. "brk=1" makes BRK a
+        // crash. Returns false if the option is not known.
+        static bool parse(const std::string& option, t_config& config);
+
+        typedef enum {RUN_DONE, RUN_CRASH, RUN_HANG} t_outcome;
+
+        // The size of the coverage map to use, unless the fuzzer decides.
+        // The map is scanned after every run, so a smaller one than AFL's
+        // is faster, and still large enough for the edges of a ROM routine.
+        static const size_t mapSize = 16384;
+
+        // Watchpoints set on the CPU beforehand are crashes, e.g. writes
+        // outside the buffers of the routine.
+        Fuzzer(Cpu65C02& cpu, Memory& memory, Coverage& coverage, const t_config& config);
+        ~Fuzzer();
+
+        // Runs from the current state up to the entry, and takes the
+        // snapshot there. Returns false if the entry is not reached.
+        bool boot();
+
+        // Runs the routine once with the input. The coverage is added to
+        // the map, which is not cleared first.
+        t_outcome run(const uint8_t* data, size_t size);
+        Cpu65C02::t_stopReason reason() const {return m_reason;}   // Of the last run.
+
+        // The built-in fuzzer. Inputs from the corpus are mutated, and
+        // those that reach new coverage are added to it. Inputs that crash
+        // are kept in crashes().
+        void addInput(const std::vector<uint8_t>& input) {m_corpus.push_back(input);}
+        void fuzz(uint64_t runs, uint32_t seed = 1);
+
+        const std::vector<std::vector<uint8_t> >& corpus() const  {return m_corpus;}
+        const std::vector<std::vector<uint8_t> >& crashes() const {return m_crashes;}
+        uint64_t runs() const  {return m_runs;}
+        uint64_t hangs() const {return m_hangs;}
+
+    private:
+        Cpu65C02& m_cpu;
+        Memory&   m_memory;
+        Coverage& m_coverage;
+        t_config  m_config;
+        Snapshot  m_start;
+        Cpu65C02::t_stopReason m_reason;
+
+        std::vector<std::vector<uint8_t> > m_corpus;
+        std::vector<std::vector<uint8_t> > m_crashes;
+        std::vector<uint8_t> m_virgin;      // Hit count classes seen so far, as in AFL.
+        std::vector<uint8_t> m_virginCrash; // The same for the crashes.
+        uint64_t m_runs;
+        uint64_t m_hangs;
+        uint32_t m_random;
+
+        uint32_t random();
+        void mutate(std::vector<uint8_t>& input);
+        bool takeCoverage(std::vector<uint8_t>& virgin);
+}; // end of class Fuzzer
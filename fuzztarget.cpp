@@ -0,0 +1,136 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include "fuzz.h"
+#include "image.h"
+
+// Fuzzing a routine of a ROM with libFuzzer or AFL++. The fuzzer sees the
+// coverage of the guest program, not that of the emulator, which is built
+// without their instrumentation. The ROM and the options of "cpu65c02
+// -fuzz" (see Fuzzer::parse()) are taken from the environment, e.g.
+//   FUZZ_ROM=firmware.bin FUZZ_OPTIONS="entry=c000 input=0200 size=64 done=c080"
+//
+// Built with clang++ -fsanitize=fuzzer -DFUZZ_LIBFUZZER ("make libfuzzer"),
+// the coverage map is one of libFuzzer's extra counter arrays. Built with
+// afl-clang-fast++ ("make afl"), it runs in the persistent mode of AFL++,
+// with the map in AFL's shared memory. Otherwise it runs the files given
+// on the command line once each, e.g. to reproduce a crash, and exits
+// with 1 if any of them crashed.
+//
+// A crash aborts the process, which is how both fuzzers notice it.
+
+static Memory*   memory;
+static Cpu65C02* cpu;
+static Coverage* coverage;
+static Fuzzer*   fuzzer;
+static RomImage  image;
+
+// Boots the ROM up to the entry of the routine.
+static bool setup(uint8_t* map, size_t mapSize)
+{
+    const char* rom = getenv("FUZZ_ROM");
+    std::string fileName = rom ? rom : "rom.bin";
+    int32_t address = -1;
+    size_t at = fileName.rfind('@');
+    if (at != std::string::npos) {
+        address = strtol(fileName.c_str() + at + 1, 0, 16);
+        fileName.resize(at);
+    }
+    if (!image.loadBinary(fileName, address)) {
+        std::cerr << "Can not load " << fileName << std::endl;
+        return false;
+    }
+
+    Fuzzer::t_config config = Fuzzer::defaultConfig();
+    const char* options = getenv("FUZZ_OPTIONS");
+    std::istringstream words(options ? options : "");
+    std::string option;
+    while (words >> option)
+    {
+        if (!Fuzzer::parse(option, config)) {
+            std::cerr << "Unknown option " << option << std::endl;
+            return false;
+        }
+    }
+
+    memory = new Memory;
+    image.install(*memory);
+    cpu = new Cpu65C02(*memory);
+    coverage = new Coverage(mapSize, map);
+    fuzzer = new Fuzzer(*cpu, *memory, *coverage, config);
+    if (!fuzzer->boot()) {
+        std::cerr << "The entry is not reached" << std::endl;
+        return false;
+    }
+    return true;
+} // setup
+
+#if defined(FUZZ_LIBFUZZER)
+
+__attribute__((section("__libfuzzer_extra_counters"), used))
+static uint8_t extraCounters[Fuzzer::mapSize];
+
+extern "C" int LLVMFuzzerInitialize(int*, char***)
+{
+    if (!setup(extraCounters, sizeof(extraCounters)))
+        exit(1);
+    return 0;
+} // LLVMFuzzerInitialize
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (fuzzer->run(data, size) == Fuzzer::RUN_CRASH)
+        abort();
+    return 0;
+} // LLVMFuzzerTestOneInput
+
+#elif defined(__AFL_FUZZ_TESTCASE_LEN)
+
+extern "C" uint8_t* __afl_area_ptr;
+extern "C" uint32_t __afl_map_size;
+
+__AFL_FUZZ_INIT();
+
+int main()
+{
+    __AFL_INIT();
+    size_t mapSize = 65536;
+    while (mapSize > __afl_map_size)
+        mapSize /= 2;
+    if (!setup(__afl_area_ptr, mapSize))
+        return 1;
+
+    const uint8_t* data = __AFL_FUZZ_TESTCASE_BUF;
+    while (__AFL_LOOP(100000))
+    {
+        if (fuzzer->run(data, __AFL_FUZZ_TESTCASE_LEN) == Fuzzer::RUN_CRASH)
+            abort();
+    }
+    return 0;
+} // main
+
+#else
+
+int main(int argc, char* argv[])
+{
+    if (!setup(0, Fuzzer::mapSize))
+        return 1;
+
+    bool crashed = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::ifstream file(argv[i], std::ios::in | std::ios::binary);
+        std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        Fuzzer::t_outcome outcome = fuzzer->run(input.data(), input.size());
+        std::cout << argv[i] << ": " << (outcome == Fuzzer::RUN_CRASH ? "crash" :
+                outcome == Fuzzer::RUN_HANG ? "hang" : "done") << ", " << coverage->count() << " edges" << std::endl;
+        coverage->clear();
+        crashed |= (outcome == Fuzzer::RUN_CRASH);
+    }
+    return crashed ? 1 : 0;
+} // main
+
+#endif
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image.h"
+
+RomImage::~RomImage()
+{
+    for (const auto& mapping : m_mappings)
+        munmap(mapping.first, mapping.second);
+} // ~RomImage
+
+// Map the whole file read-only. Returns null if it can not be mapped.
+const uint8_t* RomImage::mapFile(const std::string& fileName, size_t& size)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);      // The mapping stays.
+    if (data == MAP_FAILED)
+        return 0;
+
+    size = st.st_size;
+    m_mappings.push_back(std::make_pair(data, size));
+    return (const uint8_t*) data;
+} // mapFile
+
+bool RomImage::loadBinary(const std::string& fileName, int32_t address)
+{
+    size_t size;
+    const uint8_t* data = mapFile(fileName, size);
+    if (!data)
+        return false;
+
+    if (address < 0)
+        address = 65536 - (int32_t) size;
+    if (address < 0 || address + size > 65536)
+        return false;
+
+    t_segment segment = {(uint16_t) address, size, data};
+    m_segments.push_back(segment);
+    return true;
+} // loadBinary
+
+static int hexValue(const std::string& line, size_t pos, size_t digits)
+{
+    if (pos + digits > line.size())
+        return -1;
+    int value = 0;
+    for (size_t i = pos; i < pos + digits; ++i)
+    {
+        char c = line[i];
+        int digit = (c >= '0' && c <= '9') ? c - '0' :
+                    (c >= 'A' && c <= 'F') ? c - 'A' + 10 :
+                    (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+        if (digit < 0)
+            return -1;
+        value = (value << 4) | digit;
+    }
+    return value;
+} // hexValue
+
+// Consecutive records are put together into one segment.
+bool RomImage::loadHex(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    if (!file)
+        return false;
+
+    std::vector<t_segment> segments;
+    std::vector<uint8_t> run;
+    uint32_t runStart = 0;
+    uint32_t base = 0;
+    auto flush = [&]() {
+        if (run.empty())
+            return;
+        m_buffers.push_back(run);
+        t_segment segment = {(uint16_t) runStart, run.size(), m_buffers.back().data()};
+        segments.push_back(segment);
+        run.clear();
+    };
+
+    std::string line;
+    bool end = false;
+    while (!end && std::getline(file, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        if (line[0] != ':')
+            return false;
+
+        int length = hexValue(line, 1, 2);
+        if (length < 0 || line.size() < 11 + 2*(size_t) length)
+            return false;
+        uint8_t sum = 0;
+        std::vector<uint8_t> bytes(length + 5);
+        for (size_t i = 0; i < bytes.size(); ++i)
+        {
+            int value = hexValue(line, 1 + 2*i, 2);
+            if (value < 0)
+                return false;
+            bytes[i] = value;
+            sum += value;
+        }
+        if (sum != 0)
+            return false;
+
+        uint32_t offset = (bytes[1] << 8) | bytes[2];
+        switch (bytes[3])
+        {
+            case 0x00 :     // Data
+            {
+                uint32_t addr = base + offset;
+                if (addr + length > 65536)
+                    return false;
+                if (addr != runStart + run.size()) {
+                    flush();
+                    runStart = addr;
+                }
+                run.insert(run.end(), &bytes[4], &bytes[4] + length);
+                break;
+            }
+            case 0x01 :     // End of file
+                end = true;
+                break;
+            case 0x02 :     // Extended segment address
+                base = ((bytes[4] << 8) | bytes[5]) << 4;
+                break;
+            case 0x04 :     // Extended linear address
+                base = ((bytes[4] << 8) | bytes[5]) << 16;
+                break;
+            default :       // Start addresses are of no use here.
+                break;
+        }
+    }
+    flush();
+
+    m_segments.insert(m_segments.end(), segments.begin(), segments.end());
+    return true;
+} // loadHex
+
+bool RomImage::loadLd65(const std::string& fileName, const std::string& mapFileName)
+{
+    std::ifstream map(mapFileName);
+    if (!map)
+        return false;
+
+    // The "Segment list" has a line for each segment, e.g.
+    // "CODE                  00C000  00C0FF  000100  00001".
+    std::vector<std::pair<uint32_t, uint32_t> > segments;    // Start and end.
+    std::string line;
+    bool inList = false;
+    while (std::getline(map, line))
+    {
+        if (line.compare(0, 12, "Segment list") == 0) {
+            inList = true;
+            continue;
+        }
+        if (inList && line.empty() && !segments.empty())
+            break;
+
+        char name[64];
+        unsigned start, last, size;
+        if (inList && sscanf(line.c_str(), "%63s %x %x %x", name, &start, &last, &size) == 4 && size > 0)
+            segments.push_back(std::make_pair(start, last));
+    }
+    if (segments.empty())
+        return false;
+
+    size_t size;
+    const uint8_t* data = mapFile(fileName, size);
+    if (!data)
+        return false;
+
+    uint32_t highest = 0;
+    for (const auto& segment : segments)
+        highest = std::max(highest, segment.second);
+    std::sort(segments.begin(), segments.end());
+    for (const auto& segment : segments)
+    {
+        if (segment.first + size > highest && segment.first + size <= 65536) {
+            t_segment loaded = {(uint16_t) segment.first, size, data};
+            m_segments.push_back(loaded);
+            return true;
+        }
+    }
+    return false;
+} // loadLd65
+
+void RomImage::install(Memory& memory, bool readOnly) const
+{
+    for (unsigned page = 0; page < 256; ++page)
+    {
+        unsigned base = page * 256;
+        const t_segment* only = 0;
+        unsigned count = 0;
+        for (const t_segment& segment : m_segments)
+        {
+            if (segment.address < base + 256 && base < segment.address + segment.size) {
+                only = &segment;
+                count += 1;
+            }
+        }
+        if (count == 0)
+            continue;
+
+        // A page filled by a single file is used where it is.
+        if (readOnly && count == 1 && only->address <= base && base + 256 <= only->address + only->size) {
+            memory.mapImage(page, page, only->data + (base - only->address));
+            continue;
+        }
+
+        for (const t_segment& segment : m_segments)
+        {
+            size_t from = std::max<size_t>(base, segment.address);
+            size_t to   = std::min<size_t>(base + 256, segment.address + segment.size);
+            if (from < to)
+                memory.load(from, segment.data + (from - segment.address), to - from);
+        }
+        if (readOnly)
+            memory.mapRom(page, page);
+    }
+} // install
+
+std::vector<uint8_t> RomImage::contents() const
+{
+    std::vector<uint8_t> image(65536, 0);
+    for (const t_segment& segment : m_segments)
+        std::copy(segment.data, segment.data + segment.size, &image[segment.address]);
+    return image;
+} // contents
+
+size_t RomImage::size() const
+{
+    size_t total = 0;
+    for (const t_segment& segment : m_segments)
+        total += segment.size;
+    return total;
+} // size
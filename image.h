@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "memory.h"
+
+// A program to be loaded into memory, from one or more files: raw binaries,
+// Intel HEX, or the output of ld65 placed according to its map file.
+//
+// Binary files are mapped read-only with mmap, and are never copied. When
+// installed as ROM, whole pages of the image go straight into the page
+// table, so any number of Memory instances (e.g. the jobs of a Farm) share
+// one physical copy. Pages that are only partly covered are copied.
+class RomImage
+{
+    public:
+        RomImage() {}
+        ~RomImage();
+        RomImage(const RomImage&) = delete;
+        RomImage& operator=(const RomImage&) = delete;
+
+        // A raw binary, loaded at address. By default it ends at $FFFF.
+        bool loadBinary(const std::string& fileName, int32_t address = -1);
+
+        // Intel HEX records (types 00 and 01, and 02 and 04 for addresses
+        // within 64 KB). The checksums are verified.
+        bool loadHex(const std::string& fileName);
+
+        // ld65 output with the map file (ld65 -m). The binary starts at the
+        // lowest segment from which it reaches up to the highest segment, as
+        // with the ROM area of ld.cfg.
+        bool loadLd65(const std::string& fileName, const std::string& mapFileName);
+
+        // Put the image into memory, either as ROM or copied into RAM (e.g.
+        // for code that modifies itself). Files loaded later take precedence.
+        void install(Memory& memory, bool readOnly = true) const;
+
+        // The whole 64 KB as installed, zero where nothing is loaded.
+        std::vector<uint8_t> contents() const;
+
+        bool empty() const {return m_segments.empty();}
+        size_t size() const;    // Number of bytes loaded.
+
+    private:
+        typedef struct {
+            uint16_t       address;
+            size_t         size;
+            const uint8_t* data;
+        } t_segment;
+
+        std::vector<t_segment> m_segments;
+        std::vector<std::pair<void*, size_t> > m_mappings;  // Files mapped with mmap.
+        std::vector<std::vector<uint8_t> > m_buffers;       // Contents of HEX files.
+
+        const uint8_t* mapFile(const std::string& fileName, size_t& size);
+}; // end of class RomImage
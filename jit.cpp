@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <sys/mman.h>
+#include "jit.h"
+#include "decode.h"
+
+static const size_t   codeSize        = 16*1024*1024;
+static const uint32_t maxInstructions = 64;     // Per block.
+static const size_t   maxBlockSize    = 64 + maxInstructions*64;
+
+CpuJit::CpuJit(Cpu65C02& cpu) : m_cpu(cpu), m_codeUsed(0),
+    m_blockIndex(65536, -1), m_pageBlocks(256), m_abort(0)
+{
+    void* buffer = mmap(0, codeSize, PROT_READ | PROT_WRITE | PROT_EXEC,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    m_codeBuffer = (buffer == MAP_FAILED) ? 0 : (uint8_t*) buffer;
+    m_cpu.setCodeObserver(this);
+} // CpuJit
+
+CpuJit::~CpuJit()
+{
+    m_cpu.setCodeObserver(0);
+    if (m_codeBuffer)
+        munmap(m_codeBuffer, codeSize);
+} // ~CpuJit
+
+void CpuJit::emit8(uint8_t value)
+{
+    m_codeBuffer[m_codeUsed++] = value;
+}
+
+void CpuJit::emit32(uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+        emit8(value >> (8*i));
+}
+
+void CpuJit::emit64(uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        emit8(value >> (8*i));
+}
+
+// Discard all translated code.
+void CpuJit::flush()
+{
+    m_codeUsed = 0;
+    m_blocks.clear();
+    m_decoded.clear();
+    std::fill(m_blockIndex.begin(), m_blockIndex.end(), -1);
+    for (auto& page : m_pageBlocks)
+        page.clear();
+} // flush
+
+// Translate the basic block starting at pc. The generated code is:
+//
+//      push rbx
+//      mov  rbx, rdi                   ; Pointer to the CPU
+//    For each instruction:
+//      mov  rdi, rbx
+//      mov  rsi, <decoded instruction>
+//      mov  rax, <handler>
+//      call rax
+//    And after instructions writing to memory:
+//      mov  rax, <m_abort>
+//      cmp  byte [rax], 0
+//      je   next
+//      mov  eax, <instructions so far>
+//      jmp  exit
+//    next:
+//      ...
+//      mov  eax, <instructions in block>
+//    exit:
+//      pop  rbx
+//      ret
+const CpuJit::t_block& CpuJit::translate(uint16_t pc)
+{
+    if (m_codeUsed + maxBlockSize > codeSize)
+        flush();
+
+    t_block block;
+    block.code  = (t_code) (m_codeBuffer + m_codeUsed);
+    block.count  = 0;
+    block.cycles = 0;
+
+    std::vector<size_t> exits;      // Positions of jumps to the exit.
+    std::vector<uint8_t> pages;     // Pages this block has been registered in.
+
+    emit8(0x53);                                // push rbx
+    emit8(0x48); emit8(0x89); emit8(0xFB);      // mov rbx, rdi
+
+    uint16_t addr = pc;
+    while (true)
+    {
+        // Each instruction is called separately, so fused pairs are not.
+        m_decoded.push_back(m_cpu.decode(addr));
+        m_decoded.back().handler = m_cpu.unfusedHandler(m_decoded.back().opcode);
+        const Cpu65C02::t_decoded& d = m_decoded.back();
+        block.lastPc = addr;
+        block.count += 1;
+        // At most three cycles more than in the table: one for crossing a
+        // page, or two for a branch taken to another page, and one in
+        // decimal mode.
+        block.cycles += cycles[d.opcode] + 3;
+
+        emit8(0x48); emit8(0x89); emit8(0xDF);  // mov rdi, rbx
+        emit8(0x48); emit8(0xBE); emit64((uint64_t) &d);         // mov rsi, imm64
+        emit8(0x48); emit8(0xB8); emit64((uint64_t) d.handler);  // mov rax, imm64
+        emit8(0xFF); emit8(0xD0);               // call rax
+
+        for (uint8_t i = 0; i < d.length; ++i)
+        {
+            uint8_t page = (uint16_t) (addr+i) >> 8;
+            if (std::find(pages.begin(), pages.end(), page) == pages.end())
+            {
+                pages.push_back(page);
+                m_pageBlocks[page].push_back(pc);
+            }
+        }
+        addr += d.length;
+
+        if (endsBlock((instruction_t) d.instruction) || block.count == maxInstructions)
+            break;
+
+        // CLI and PLP may allow a pending interrupt, which the interpreter
+        // takes before the next instruction. The run loop does that too,
+        // if the block ends here.
+        if (d.instruction == I_CLI || d.instruction == I_PLP)
+            break;
+
+        if (writesMemory((instruction_t) d.instruction))
+        {
+            emit8(0x48); emit8(0xB8); emit64((uint64_t) &m_abort);  // mov rax, imm64
+            emit8(0x80); emit8(0x38); emit8(0x00);  // cmp byte [rax], 0
+            emit8(0x74); emit8(0x0A);               // je +10
+            emit8(0xB8); emit32(block.count);       // mov eax, imm32
+            emit8(0xE9); exits.push_back(m_codeUsed); emit32(0);    // jmp rel32
+        }
+    }
+
+    emit8(0xB8); emit32(block.count);           // mov eax, imm32
+    for (size_t pos : exits)
+    {
+        uint32_t rel = m_codeUsed - (pos + 4);
+        for (int i = 0; i < 4; ++i)
+            m_codeBuffer[pos+i] = rel >> (8*i);
+    }
+    emit8(0x5B);                                // pop rbx
+    emit8(0xC3);                                // ret
+
+    m_blockIndex[pc] = m_blocks.size();
+    m_blocks.push_back(block);
+    return m_blocks.back();
+} // translate
+
+// Something has been written to a page with translated code.
+void CpuJit::invalidate(uint16_t addr)
+{
+    std::vector<uint16_t>& blocks = m_pageBlocks[addr >> 8];
+    if (blocks.empty())
+        return;
+
+    for (uint16_t pc : blocks)
+        m_blockIndex[pc] = -1;
+    blocks.clear();
+    m_abort = 1;
+} // invalidate
+
+Cpu65C02::t_stopReason CpuJit::run(uint64_t budget, uint32_t stopMask)
+{
+#if defined(__x86_64__)
+    // Breakpoints, watchpoints, profiling and coverage are only handled by the interpreter.
+    bool useJit = m_codeBuffer && !m_cpu.m_profiler && !m_cpu.m_coverage &&
+                  !(m_cpu.m_breakpointCount && (stopMask & Cpu65C02::STOP_BREAKPOINT)) &&
+                  !(m_cpu.m_memory.watchpointCount() && (stopMask & Cpu65C02::STOP_WATCHPOINT));
+
+    while (useJit)
+    {
+        int32_t index = m_blockIndex[m_cpu.m_pc];
+        const t_block block = (index >= 0) ? m_blocks[index] : translate(m_cpu.m_pc);
+
+        // Events, interrupts and WAI are handled by the interpreter, one
+        // instruction at a time. So is a block during which an event may
+        // fall due, for it to be taken at the same instruction.
+        if (m_cpu.m_cycles + block.cycles >= m_cpu.m_scheduler.next() || m_cpu.m_waiting) {
+            if (budget == 0)
+                break;
+            uint64_t before = m_cpu.m_instCounter;
+            Cpu65C02::t_stopReason reason = m_cpu.run(1, stopMask);
+            budget -= m_cpu.m_instCounter - before;
+            if (reason != Cpu65C02::STOP_BUDGET)
+                return reason;
+            continue;
+        }
+
+        // The rest of the budget is handled by the interpreter.
+        if (block.count > budget)
+            break;
+
+        m_abort = 0;
+        uint32_t executed = block.code(&m_cpu);
+        m_cpu.m_instCounter += executed;
+        budget -= executed;
+
+        if (m_cpu.m_stop) {
+            uint32_t hit = m_cpu.m_stop & stopMask;
+            m_cpu.m_stop = 0;
+            if (hit)
+                return (Cpu65C02::t_stopReason) (hit & -hit);
+        }
+
+        // Only the last instruction of a block can jump back to itself. No
+        // event was due before it, as the interpreter checks for that
+        // before each instruction, and for the jump after it.
+        if (executed == block.count && m_cpu.m_pc == block.lastPc && (stopMask & Cpu65C02::STOP_SELF_JUMP))
+            return Cpu65C02::STOP_SELF_JUMP;
+
+        // Polling loops are skipped by the interpreter.
+        if (executed == block.count && (uint16_t) (block.lastPc - m_cpu.m_pc) < Cpu65C02::IDLE_LOOP_BYTES &&
+            m_cpu.m_loops[block.lastPc] != Cpu65C02::LOOP_BUSY)
+            budget -= m_cpu.idle(block.lastPc, budget, Scheduler::NEVER, stopMask);
+    }
+#endif
+
+    // Fall back to the interpreter.
+    return m_cpu.run(budget, stopMask);
+} // run
+
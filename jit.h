@@ -0,0 +1,70 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "cpu65c02.h"
+
+// A basic-block translator producing x86-64 host code.
+//
+// A block starts at the current PC and ends with the first branch, jump,
+// JSR, RTS, RTI, BRK, BBR or BBS, or after CLI or PLP, which may let a
+// pending interrupt in. Each instruction in the block becomes a
+// direct call to the specialized handler of its opcode, so the semantics
+// are exactly those of the interpreter, but without any fetch, decode or
+// dispatch at run time.
+//
+// Writes to a page containing translated code discard all blocks on that
+// page. A block that modifies itself stops right after the write, and
+// continues in a freshly translated block.
+//
+// On other hosts than x86-64 the interpreter is used instead.
+class CpuJit : public MemoryObserver
+{
+    public:
+        CpuJit(Cpu65C02& cpu);
+        ~CpuJit();
+
+        // Executes up to budget instructions, like Cpu65C02::run().
+        // Breakpoints are only supported by the interpreter, so setting
+        // any disables the translated code.
+        Cpu65C02::t_stopReason run(uint64_t budget, uint32_t stopMask = Cpu65C02::STOP_ALL);
+
+        // Called by the CPU when a cached instruction byte is overwritten.
+        virtual void invalidate(uint16_t addr);
+
+    private:
+        // Signature of the translated code. Returns the number of
+        // instructions executed.
+        typedef uint32_t (*t_code)(Cpu65C02* cpu);
+
+        typedef struct {
+            t_code   code;
+            uint32_t count;     // Number of instructions in the block.
+            uint32_t cycles;    // Most clock cycles it can take.
+            uint16_t lastPc;    // Address of the last instruction.
+        } t_block;
+
+        Cpu65C02& m_cpu;
+
+        uint8_t* m_codeBuffer;  // Executable memory for the translated code.
+        size_t   m_codeUsed;
+
+        std::vector<int32_t>  m_blockIndex; // Indexed by PC. -1 means not translated.
+        std::vector<t_block>  m_blocks;
+        std::vector<std::vector<uint16_t> > m_pageBlocks; // Start addresses of blocks on each page.
+
+        // Copies of the decoded instructions, referenced from the translated
+        // code. A deque never moves its elements.
+        std::deque<Cpu65C02::t_decoded> m_decoded;
+
+        volatile uint8_t m_abort;   // Set when translated code is invalidated.
+
+        const t_block& translate(uint16_t pc);
+        void flush();
+
+        // Helpers for writing machine code.
+        void emit8(uint8_t value);
+        void emit32(uint32_t value);
+        void emit64(uint64_t value);
+}; // end of class CpuJit
+
@@ -0,0 +1,821 @@
+#include <algorithm>
+#include "lanes.h"
+#include "decimal.h"
+#include "decode.h"
+
+// The bits of the status register, as in Cpu65C02.
+enum {
+    FLAG_C = 0x01, FLAG_Z = 0x02, FLAG_I = 0x04, FLAG_D = 0x08,
+    FLAG_B = 0x10, FLAG_R = 0x20, FLAG_V = 0x40, FLAG_N = 0x80
+};
+
+// Set S and Z from the result.
+static inline uint8_t nz(uint8_t flags, uint8_t value)
+{
+    return (flags & ~(FLAG_N | FLAG_Z)) | (value & FLAG_N) | ((value == 0) ? FLAG_Z : 0);
+}
+
+// Runs op on every lane. The loop is simple enough to be vectorized.
+template <typename OP>
+static inline void forLanes(uint8_t* result, const uint8_t* arg1, const uint8_t* arg2, uint8_t* flags, OP op)
+{
+    for (unsigned l = 0; l < CpuLanes::LANES; ++l)
+        result[l] = op(arg1[l], arg2[l], flags[l]);
+}
+
+// The same for ADC and SBC, looking up the lanes in decimal mode in the table.
+template <typename OP>
+static inline void forDecimalLanes(const uint16_t* table, uint8_t* result, const uint8_t* arg1, const uint8_t* arg2,
+        uint8_t* flags, OP op)
+{
+    uint8_t decimal = 0;
+    for (unsigned l = 0; l < CpuLanes::LANES; ++l)
+        decimal |= flags[l];
+    if (!(decimal & FLAG_D)) {
+        forLanes(result, arg1, arg2, flags, op);
+        return;
+    }
+
+    for (unsigned l = 0; l < CpuLanes::LANES; ++l)
+    {
+        if (flags[l] & FLAG_D) {
+            uint16_t entry = table[decimalIndex(flags[l] & FLAG_C, arg1[l], arg2[l])];
+            uint8_t  carry = (entry & DECIMAL_C) ? FLAG_C : 0;
+            uint8_t  v     = (entry & DECIMAL_V) ? FLAG_V : 0;
+            result[l] = entry & 0xFF;
+            flags[l]  = nz((flags[l] & ~(FLAG_C | FLAG_V)) | carry | v, result[l]);
+        }
+        else
+            result[l] = op(arg1[l], arg2[l], flags[l]);
+    }
+}
+
+CpuLanes::CpuLanes(const std::vector<uint8_t>& rom) : m_mem(65536 * LANES, 0), m_code(65536, 0),
+    m_decoded(65536), m_pc(0), m_size(0), m_masked(false), m_split(false), m_count(0), m_stop(0), m_waiting(false),
+    m_first(0), m_minWaiting(0), m_waitingAt(65536, 0), m_uniform(true),
+    m_scalar(LANES), m_results(LANES), m_lockstep(0)
+{
+    size_t base = 65536 - rom.size();
+    for (size_t i = 0; i < rom.size(); ++i)
+        for (unsigned l = 0; l < LANES; ++l)
+            m_mem[index(l, base + i)] = rom[i];
+
+    // The same state as a freshly reset Cpu65C02.
+    Cpu65C02::t_registers regs = {};
+    regs.pc = (peek(0, 0xFFFD) << 8) | peek(0, 0xFFFC);
+    regs.sp = 0xFF;
+    for (unsigned l = 0; l < LANES; ++l)
+    {
+        setRegisters(l, regs);
+        m_active[l]    = 0;
+        m_alive[l]     = 1;
+        m_diverged[l]  = 0;
+        m_laneCount[l] = 0;
+    }
+} // CpuLanes
+
+CpuLanes::~CpuLanes()
+{
+} // ~CpuLanes
+
+void CpuLanes::setRegisters(unsigned lane, const Cpu65C02::t_registers& regs)
+{
+    m_lanePc[lane] = regs.pc;
+    m_areg[lane]   = regs.areg;
+    m_xreg[lane]   = regs.xreg;
+    m_yreg[lane]   = regs.yreg;
+    m_sp[lane]     = regs.sp;
+    m_flags[lane]  = regs.flags;
+} // setRegisters
+
+Cpu65C02::t_registers CpuLanes::registers(unsigned lane) const
+{
+    Cpu65C02::t_registers regs;
+    regs.pc    = (m_active[lane] && !m_diverged[lane]) ? m_pc : m_lanePc[lane];
+    regs.areg  = m_areg[lane];
+    regs.xreg  = m_xreg[lane];
+    regs.yreg  = m_yreg[lane];
+    regs.sp    = m_sp[lane];
+    regs.flags = m_flags[lane];
+    return regs;
+} // registers
+
+uint8_t CpuLanes::peek(unsigned lane, uint16_t addr) const
+{
+    if (m_scalar[lane].memory)
+        return m_scalar[lane].memory->peek(addr);
+    return m_mem[index(lane, addr)];
+} // peek
+
+// Hand the lane over to its own scalar CPU.
+void CpuLanes::split(unsigned lane)
+{
+    uint64_t instructions = count(lane);
+    std::vector<uint8_t> image(65536);
+    for (unsigned addr = 0; addr < 65536; ++addr)
+        image[addr] = m_mem[index(lane, addr)];
+
+    t_scalar& scalar = m_scalar[lane];
+    scalar.memory.reset(new Memory(image));
+    scalar.cpu.reset(new Cpu65C02(*scalar.memory));
+    scalar.cpu->setRegisters(registers(lane));
+    scalar.instructions = instructions;
+
+    m_lockstep += instructions;
+    if (m_active[lane]) {
+        m_masked = true;
+        m_size  -= 1;
+    }
+    m_active[lane]   = 0;
+    m_alive[lane]    = 0;
+    m_diverged[lane] = 0;
+    if (lane == m_first)
+        m_first = firstActive();
+} // split
+
+void CpuLanes::finish(unsigned lane, Cpu65C02::t_stopReason reason)
+{
+    t_result& result = m_results[lane];
+    result.registers    = registers(lane);
+    result.reason       = reason;
+    result.instructions = count(lane);
+    result.scalar       = false;
+
+    m_lockstep += result.instructions;
+    m_masked = true;
+    m_size  -= 1;
+    m_active[lane]   = 0;
+    m_alive[lane]    = 0;
+    m_diverged[lane] = 0;
+    if (lane == m_first)
+        m_first = firstActive();
+} // finish
+
+// Take the lane out of the group, to wait at its own address.
+void CpuLanes::leave(unsigned lane)
+{
+    m_lanePc[lane] = registers(lane).pc;
+    m_laneCount[lane] += m_count;
+    m_waitingAt[m_lanePc[lane]] = 1;
+    m_minWaiting = std::min(m_minWaiting, priority(m_sp[lane], m_lanePc[lane]));
+
+    m_masked = true;
+    m_size  -= 1;
+    m_active[lane]   = 0;
+    m_diverged[lane] = 0;
+    if (lane == m_first)
+        m_first = firstActive();
+} // leave
+
+unsigned CpuLanes::firstActive() const
+{
+    unsigned l = 0;
+    while (l < LANES - 1 && !m_active[l])
+        ++l;
+    return l;
+} // firstActive
+
+// Make the lanes with the highest priority() the group, and set remaining
+// to the most instructions it can run before a lane reaches the budget.
+// Returns false when no lane is left.
+bool CpuLanes::group(uint64_t budget, uint64_t& remaining)
+{
+    bool any = false;
+    uint32_t best = 0;
+    for (unsigned l = 0; l < LANES; ++l)
+    {
+        if (m_alive[l] && (!any || priority(m_sp[l], m_lanePc[l]) < best)) {
+            best = priority(m_sp[l], m_lanePc[l]);
+            m_pc = m_lanePc[l];
+            any  = true;
+        }
+        m_waitingAt[m_lanePc[l]] = 0;
+    }
+    if (!any)
+        return false;
+
+    uint64_t most = 0;
+    m_count      = 0;
+    m_size       = 0;
+    m_masked     = false;
+    m_minWaiting = ~0u;
+    for (unsigned l = 0; l < LANES; ++l)
+    {
+        m_active[l] = m_alive[l] && m_lanePc[l] == m_pc;
+        if (m_active[l]) {
+            most = std::max(most, m_laneCount[l]);
+            m_size += 1;
+        } else {
+            m_masked = true;
+            if (m_alive[l]) {
+                m_waitingAt[m_lanePc[l]] = 1;
+                m_minWaiting = std::min(m_minWaiting, priority(m_sp[l], m_lanePc[l]));
+            }
+        }
+    }
+    m_first = firstActive();
+    remaining = budget - most;
+    return true;
+} // group
+
+// Decode the instruction at the given address, unless it is already cached.
+// Lanes with different instruction bytes are split off, including those
+// waiting elsewhere, since they may run the cached instruction later.
+const Cpu65C02::t_decoded& CpuLanes::decode(uint16_t addr)
+{
+    Cpu65C02::t_decoded& d = m_decoded[addr];
+    if (d.length)
+        return d;
+
+    unsigned first = 0;
+    while (!m_active[first])
+        ++first;
+
+    uint8_t bytes[3];
+    for (uint8_t i = 0; i < 3; ++i)
+        bytes[i] = m_mem[index(first, addr + i)];
+    Cpu65C02::decodeBytes(d, addr, bytes);
+
+    for (uint8_t i = 0; i < d.length; ++i)
+        m_code[(uint16_t) (addr + i)] = 1;
+
+    for (unsigned l = 0; l < LANES; ++l)
+    {
+        if (!m_alive[l] || l == first)
+            continue;
+        for (uint8_t i = 0; i < d.length; ++i)
+        {
+            if (m_mem[index(l, addr + i)] != bytes[i]) {
+                split(l);
+                break;
+            }
+        }
+    }
+
+    return d;
+} // decode
+
+// An instruction byte has been overwritten in at least one lane.
+void CpuLanes::invalidate(uint16_t addr)
+{
+    m_code[addr] = 0;
+    for (uint8_t i = 0; i < 3; ++i)
+    {
+        Cpu65C02::t_decoded& d = m_decoded[(uint16_t) (addr-i)];
+        if (d.length > i)
+            d.length = 0;
+    }
+} // invalidate
+
+// Perform a 16-bit read from memory in every lane, low byte first.
+void CpuLanes::read16(uint16_t* result, const uint16_t* addr)
+{
+    for (unsigned l = 0; l < LANES; ++l)
+    {
+        uint8_t low = m_mem[index(l, addr[l])];
+        result[l] = (m_mem[index(l, (uint16_t) (addr[l] + 1))] << 8) | low;
+    }
+} // read16
+
+// Calculate the effective address in each lane.
+void CpuLanes::address(const Cpu65C02::t_decoded& d)
+{
+    uint16_t pointer[LANES];
+
+    m_uniform = false;
+    switch (d.addrMode)
+    {
+        case AM_IMM  : m_uniform = true; m_addr[0] = m_pc + 1; break;
+        case AM_ABS  :
+        case AM_ZP   :
+        case AM_REL  :
+        case AM_ZR   : m_uniform = true; m_addr[0] = d.operand; break;
+        case AM_NONE :
+        case AM_ACC  :
+        case AM_RES  : m_uniform = true; m_addr[0] = 0; break;
+
+        case AM_ZPX  : for (unsigned l = 0; l < LANES; ++l) m_addr[l] = (d.operand + m_xreg[l]) & 0xFF; break;
+        case AM_ZPY  : for (unsigned l = 0; l < LANES; ++l) m_addr[l] = (d.operand + m_yreg[l]) & 0xFF; break;
+        case AM_ABSX : for (unsigned l = 0; l < LANES; ++l) m_addr[l] = d.operand + m_xreg[l]; break;
+        case AM_ABSY : for (unsigned l = 0; l < LANES; ++l) m_addr[l] = d.operand + m_yreg[l]; break;
+
+        case AM_IND  :
+        case AM_IZP  : for (unsigned l = 0; l < LANES; ++l) pointer[l] = d.operand;
+                       read16(m_addr, pointer); break;
+        case AM_INDX : for (unsigned l = 0; l < LANES; ++l) pointer[l] = (d.operand + m_xreg[l]) & 0xFF;
+                       read16(m_addr, pointer); break;
+        case AM_INDY : for (unsigned l = 0; l < LANES; ++l) pointer[l] = d.operand;
+                       read16(m_addr, pointer);
+                       for (unsigned l = 0; l < LANES; ++l) m_addr[l] += m_yreg[l];
+                       break;
+        case AM_IABSX: for (unsigned l = 0; l < LANES; ++l) pointer[l] = d.operand + m_xreg[l];
+                       read16(m_addr, pointer); break;
+    } // switch (d.addrMode)
+
+    if (m_uniform)
+        for (unsigned l = 1; l < LANES; ++l)
+            m_addr[l] = m_addr[0];
+} // address
+
+void CpuLanes::load(uint8_t* value)
+{
+    if (m_uniform) {
+        const uint8_t* src = &m_mem[index(0, m_addr[0])];
+        for (unsigned l = 0; l < LANES; ++l)
+            value[l] = src[l];
+    } else {
+        for (unsigned l = 0; l < LANES; ++l)
+            value[l] = m_mem[index(l, m_addr[l])];
+    }
+} // load
+
+void CpuLanes::store(const uint8_t* value)
+{
+    // The memory of lanes outside the group is left as it was.
+    if (m_masked) {
+        for (unsigned l = 0; l < LANES; ++l)
+        {
+            uint8_t& dst = m_mem[index(l, m_addr[l])];
+            dst = m_active[l] ? value[l] : dst;
+        }
+        for (unsigned l = 0; l < LANES; ++l)
+            if (m_active[l] && m_code[m_addr[l]])
+                invalidate(m_addr[l]);
+    } else if (m_uniform) {
+        uint8_t* dst = &m_mem[index(0, m_addr[0])];
+        for (unsigned l = 0; l < LANES; ++l)
+            dst[l] = value[l];
+        if (m_code[m_addr[0]])
+            invalidate(m_addr[0]);
+    } else {
+        for (unsigned l = 0; l < LANES; ++l)
+            m_mem[index(l, m_addr[l])] = value[l];
+        for (unsigned l = 0; l < LANES; ++l)
+            if (m_code[m_addr[l]])
+                invalidate(m_addr[l]);
+    }
+} // store
+
+// The same operations as alu() in cpu65c02.cpp, on all lanes at once.
+void CpuLanes::alu(uint8_t op, uint8_t* result, const uint8_t* arg1, const uint8_t* arg2)
+{
+    switch (op)
+    {
+        case ALU_ORA:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = a | b; p = nz(p, r); return r; });
+            break;
+        case ALU_AND:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = a & b; p = nz(p, r); return r; });
+            break;
+        case ALU_EOR:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = a ^ b; p = nz(p, r); return r; });
+            break;
+        case ALU_ADC:
+            forDecimalLanes(decimalTables.adc, result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                uint16_t t = a + b + (p & FLAG_C);
+                uint8_t  r = t;
+                uint8_t  v = (~(a ^ b) & (a ^ r) & 0x80) ? FLAG_V : 0;
+                p = nz((p & ~(FLAG_C | FLAG_V)) | (t >> 8) | v, r);
+                return r; });
+            break;
+        case ALU_LDA:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t, uint8_t b, uint8_t& p) -> uint8_t {
+                p = nz(p, b); return b; });
+            break;
+        case ALU_CMP:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                uint16_t t = a + (uint8_t) ~b + 1;
+                p = nz((p & ~FLAG_C) | (t >> 8), t);
+                return a; });
+            break;
+        case ALU_SBC:
+            forDecimalLanes(decimalTables.sbc, result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t  nb = ~b;
+                uint16_t t  = a + nb + (p & FLAG_C);
+                uint8_t  r  = t;
+                uint8_t  v  = (~(a ^ nb) & (a ^ r) & 0x80) ? FLAG_V : 0;
+                p = nz((p & ~(FLAG_C | FLAG_V)) | (t >> 8) | v, r);
+                return r; });
+            break;
+        case ALU_ASL:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = b << 1; p = nz((p & ~FLAG_C) | (b >> 7), r); return r; });
+            break;
+        case ALU_ROL:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = (b << 1) | (p & FLAG_C); p = nz((p & ~FLAG_C) | (b >> 7), r); return r; });
+            break;
+        case ALU_LSR:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = b >> 1; p = nz((p & ~FLAG_C) | (b & 1), r); return r; });
+            break;
+        case ALU_ROR:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = (b >> 1) | ((p & FLAG_C) << 7); p = nz((p & ~FLAG_C) | (b & 1), r); return r; });
+            break;
+        case ALU_DEC:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = b - 1; p = nz(p, r); return r; });
+            break;
+        case ALU_INC:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t, uint8_t b, uint8_t& p) -> uint8_t {
+                uint8_t r = b + 1; p = nz(p, r); return r; });
+            break;
+        case ALU_BIT:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                p = (p & ~(FLAG_N | FLAG_V | FLAG_Z)) | (b & (FLAG_N | FLAG_V)) | ((a & b) ? 0 : FLAG_Z);
+                return a & b; });
+            break;
+        case ALU_TRB:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                p = (p & ~FLAG_Z) | ((a & b) ? 0 : FLAG_Z); return b & ~a; });
+            break;
+        case ALU_TSB:
+            forLanes(result, arg1, arg2, m_flags, [](uint8_t a, uint8_t b, uint8_t& p) -> uint8_t {
+                p = (p & ~FLAG_Z) | ((a & b) ? 0 : FLAG_Z); return b | a; });
+            break;
+    }
+} // alu
+
+// A conditional branch. If the lanes disagree, the majority stays in the group.
+void CpuLanes::branch(const uint8_t* taken, uint16_t target)
+{
+    unsigned active = 0;
+    unsigned count  = 0;
+    for (unsigned l = 0; l < LANES; ++l)
+    {
+        active += m_active[l] != 0;
+        count  += m_active[l] && taken[l];
+    }
+
+    if (count == 0)
+        return;
+    if (count < active) {
+        bool stay = (2*count >= active);
+        for (unsigned l = 0; l < LANES; ++l)
+        {
+            if (m_active[l] && (taken[l] != 0) != stay) {
+                m_lanePc[l]   = taken[l] ? target : m_pc;
+                m_diverged[l] = 1;
+                m_split = true;
+            }
+        }
+        if (!stay)
+            return;
+    }
+    m_pc = target;
+} // branch
+
+// A jump to an address read from memory. The most common address is kept.
+void CpuLanes::jump(const uint16_t* pc)
+{
+    unsigned first = 0;
+    while (!m_active[first])
+        ++first;
+
+    bool same = true;
+    for (unsigned l = 0; l < LANES; ++l)
+        same = same && (!m_active[l] || pc[l] == pc[first]);
+
+    uint16_t target = pc[first];
+    if (!same) {
+        unsigned best = 0;
+        for (unsigned l = 0; l < LANES; ++l)
+        {
+            unsigned count = 0;
+            for (unsigned k = 0; k < LANES; ++k)
+                count += m_active[l] && m_active[k] && pc[k] == pc[l];
+            if (count > best) {
+                best   = count;
+                target = pc[l];
+            }
+        }
+        for (unsigned l = 0; l < LANES; ++l)
+        {
+            if (m_active[l] && pc[l] != target) {
+                m_lanePc[l]   = pc[l];
+                m_diverged[l] = 1;
+                m_split = true;
+            }
+        }
+    }
+    m_pc = target;
+} // jump
+
+// Executes a decoded instruction in all lanes. This follows
+// Cpu65C02::execute() closely.
+void CpuLanes::execute(const Cpu65C02::t_decoded& d)
+{
+    alignas(16) uint8_t  value[LANES];
+    alignas(16) uint8_t  taken[LANES];
+    alignas(16) uint16_t pc[LANES];
+    uint8_t bit = 1 << ((d.opcode >> 4) & 7);
+
+    if (d.addrMode == AM_RES) {
+        m_stop |= Cpu65C02::STOP_ILLEGAL;
+        return;
+    }
+    address(d);
+    m_pc += d.length;
+
+    // Stack addresses, including the wrap of 0x0100 | (sp-1) to $FFFF.
+    auto stack = [this](int offset) {
+        m_uniform = false;
+        for (unsigned l = 0; l < LANES; ++l)
+            m_addr[l] = 0x0100 | (m_sp[l] + offset);
+    };
+    auto pop = [this, &stack](uint8_t* reg, bool flags) {
+        for (unsigned l = 0; l < LANES; ++l)
+            m_sp[l] += 1;
+        stack(0);
+        if (flags)
+            load(reg);
+        else {
+            alignas(16) uint8_t pulled[LANES];
+            load(pulled);
+            alu(ALU_LDA, reg, reg, pulled);
+        }
+    };
+    auto push = [this, &stack](const uint8_t* value) {
+        stack(0);
+        store(value);
+        for (unsigned l = 0; l < LANES; ++l)
+            m_sp[l] -= 1;
+    };
+    auto test = [this, &taken](uint8_t mask, bool set) {
+        for (unsigned l = 0; l < LANES; ++l)
+            taken[l] = ((m_flags[l] & mask) != 0) == set;
+    };
+    auto setFlags = [this](uint8_t clear, uint8_t set) {
+        for (unsigned l = 0; l < LANES; ++l)
+            m_flags[l] = (m_flags[l] & ~clear) | set;
+    };
+    // Push the return address, high byte first.
+    auto pushPc = [this, &stack, &value](uint16_t addr) {
+        stack(0);
+        for (unsigned l = 0; l < LANES; ++l) value[l] = addr >> 8;
+        store(value);
+        stack(-1);
+        for (unsigned l = 0; l < LANES; ++l) value[l] = addr & 0xFF;
+        store(value);
+        for (unsigned l = 0; l < LANES; ++l)
+            m_sp[l] -= 2;
+    };
+    // Pull a 16-bit address from the stack.
+    auto pullPc = [this, &stack, &pc]() {
+        for (unsigned l = 0; l < LANES; ++l)
+            m_sp[l] += 2;
+        stack(-1);
+        read16(pc, m_addr);
+    };
+
+    switch (d.instruction)
+    {
+        case I_RES: m_pc -= d.length; m_stop |= Cpu65C02::STOP_ILLEGAL; break;
+
+        case I_ORA: load(value); alu(ALU_ORA, m_areg, m_areg, value); break;
+        case I_AND: load(value); alu(ALU_AND, m_areg, m_areg, value); break;
+        case I_EOR: load(value); alu(ALU_EOR, m_areg, m_areg, value); break;
+        case I_ADC: load(value); alu(ALU_ADC, m_areg, m_areg, value); break;
+        case I_STA: store(m_areg); break;
+        case I_LDA: load(value); alu(ALU_LDA, m_areg, m_areg, value); break;
+        case I_CMP: load(value); alu(ALU_CMP, value, m_areg, value); break;
+        case I_SBC: load(value); alu(ALU_SBC, m_areg, m_areg, value); break;
+        case I_STZ: for (unsigned l = 0; l < LANES; ++l) value[l] = 0;
+                    store(value); break;
+
+        case I_CLC: setFlags(FLAG_C, 0); break;
+        case I_SEC: setFlags(0, FLAG_C); break;
+        case I_CLI: setFlags(FLAG_I, 0); break;
+        case I_SEI: setFlags(0, FLAG_I); break;
+        case I_CLV: setFlags(FLAG_V, 0); break;
+        case I_CLD: setFlags(FLAG_D, 0); break;
+        case I_SED: setFlags(0, FLAG_D); break;
+
+        case I_BPL: test(FLAG_N, false); branch(taken, m_addr[0]); break;
+        case I_BMI: test(FLAG_N, true);  branch(taken, m_addr[0]); break;
+        case I_BVC: test(FLAG_V, false); branch(taken, m_addr[0]); break;
+        case I_BVS: test(FLAG_V, true);  branch(taken, m_addr[0]); break;
+        case I_BCC: test(FLAG_C, false); branch(taken, m_addr[0]); break;
+        case I_BCS: test(FLAG_C, true);  branch(taken, m_addr[0]); break;
+        case I_BNE: test(FLAG_Z, false); branch(taken, m_addr[0]); break;
+        case I_BEQ: test(FLAG_Z, true);  branch(taken, m_addr[0]); break;
+        case I_BRA: m_pc = m_addr[0]; break;
+
+        case I_BBR:
+        case I_BBS: {
+            const uint8_t* zp = &m_mem[index(0, d.zp)];
+            bool set = (d.instruction == I_BBS);
+            for (unsigned l = 0; l < LANES; ++l)
+                taken[l] = ((zp[l] & (1 << d.bit)) != 0) == set;
+            branch(taken, m_addr[0]);
+            break;
+        }
+        case I_TRB: load(value); alu(ALU_TRB, value, m_areg, value); store(value); break;
+        case I_TSB: load(value); alu(ALU_TSB, value, m_areg, value); store(value); break;
+        case I_RMB: load(value); for (unsigned l = 0; l < LANES; ++l) value[l] &= ~bit;
+                    store(value); break;
+        case I_SMB: load(value); for (unsigned l = 0; l < LANES; ++l) value[l] |= bit;
+                    store(value); break;
+
+        case I_PHP: for (unsigned l = 0; l < LANES; ++l) value[l] = 0x30 | m_flags[l];
+                    push(value); break;
+        case I_JSR: { uint16_t target = m_addr[0]; pushPc(m_pc-1); m_pc = target; break; }
+        case I_PLP: pop(m_flags, true); break;
+        case I_PHA: push(m_areg); break;
+        case I_RTS: pullPc();
+                    for (unsigned l = 0; l < LANES; ++l) pc[l] += 1;
+                    jump(pc); break;
+        case I_PLA: pop(m_areg, false); break;
+
+        case I_PHX: push(m_xreg); break;
+        case I_PLX: pop(m_xreg, false); break;
+        case I_PHY: push(m_yreg); break;
+        case I_PLY: pop(m_yreg, false); break;
+
+        case I_INCA: alu(ALU_INC, m_areg, m_areg, m_areg); break;
+        case I_DECA: alu(ALU_DEC, m_areg, m_areg, m_areg); break;
+        case I_ASLA: alu(ALU_ASL, m_areg, m_areg, m_areg); break;
+        case I_ROLA: alu(ALU_ROL, m_areg, m_areg, m_areg); break;
+        case I_LSRA: alu(ALU_LSR, m_areg, m_areg, m_areg); break;
+        case I_RORA: alu(ALU_ROR, m_areg, m_areg, m_areg); break;
+        case I_ASL: load(value); alu(ALU_ASL, value, value, value); store(value); break;
+        case I_ROL: load(value); alu(ALU_ROL, value, value, value); store(value); break;
+        case I_LSR: load(value); alu(ALU_LSR, value, value, value); store(value); break;
+        case I_ROR: load(value); alu(ALU_ROR, value, value, value); store(value); break;
+        case I_DEC: load(value); alu(ALU_DEC, value, value, value); store(value); break;
+        case I_INC: load(value); alu(ALU_INC, value, value, value); store(value); break;
+        case I_BIT: load(value);
+                    if (d.addrMode == AM_IMM) {
+                        for (unsigned l = 0; l < LANES; ++l)
+                            m_flags[l] = (m_flags[l] & ~FLAG_Z) | ((m_areg[l] & value[l]) ? 0 : FLAG_Z);
+                    }
+                    else
+                        alu(ALU_BIT, value, m_areg, value);
+                    break;
+
+        case I_STX: store(m_xreg); break;
+        case I_LDX: load(value); alu(ALU_LDA, m_xreg, m_xreg, value); break;
+        case I_CPX: load(value); alu(ALU_CMP, value, m_xreg, value); break;
+        case I_INX: alu(ALU_INC, m_xreg, m_xreg, m_xreg); break;
+        case I_DEX: alu(ALU_DEC, m_xreg, m_xreg, m_xreg); break;
+        case I_TAX: alu(ALU_LDA, m_xreg, m_xreg, m_areg); break;
+        case I_TXA: alu(ALU_LDA, m_areg, m_areg, m_xreg); break;
+        case I_TSX: alu(ALU_LDA, m_xreg, m_xreg, m_sp); break;
+        case I_TXS: for (unsigned l = 0; l < LANES; ++l) m_sp[l] = m_xreg[l];
+                    break;
+
+        case I_STY: store(m_yreg); break;
+        case I_LDY: load(value); alu(ALU_LDA, m_yreg, m_yreg, value); break;
+        case I_CPY: load(value); alu(ALU_CMP, value, m_yreg, value); break;
+        case I_INY: alu(ALU_INC, m_yreg, m_yreg, m_yreg); break;
+        case I_DEY: alu(ALU_DEC, m_yreg, m_yreg, m_yreg); break;
+        case I_TAY: alu(ALU_LDA, m_yreg, m_yreg, m_areg); break;
+        case I_TYA: alu(ALU_LDA, m_areg, m_areg, m_yreg); break;
+
+        case I_NOP: break;
+        case I_BRK: pushPc(m_pc);
+                    for (unsigned l = 0; l < LANES; ++l) value[l] = 0x30 | m_flags[l];
+                    push(value);
+                    setFlags(FLAG_D, FLAG_I);
+                    for (unsigned l = 0; l < LANES; ++l) m_addr[l] = 0xFFFE;
+                    read16(pc, m_addr);
+                    jump(pc);
+                    m_stop |= Cpu65C02::STOP_BRK;
+                    break;
+        case I_RTI: pop(m_flags, true);
+                    pullPc();
+                    jump(pc);
+                    break;
+
+        case I_JMP: if (m_uniform)
+                        m_pc = m_addr[0];
+                    else
+                        jump(m_addr);
+                    break;
+
+        case I_WAI: m_waiting = true; break;
+        case I_STP: m_pc -= d.length; m_stop |= Cpu65C02::STOP_STP; break;
+    } // switch (d.instruction)
+} // execute
+
+void CpuLanes::run(uint64_t budget, uint32_t stopMask)
+{
+    uint64_t remaining;
+    while (group(budget, remaining))
+    {
+        while (true)
+        {
+            if (m_count == remaining) {
+                for (unsigned l = 0; l < LANES; ++l)
+                    if (m_active[l] && count(l) == budget)
+                        finish(l, Cpu65C02::STOP_BUDGET);
+                break;
+            }
+
+            // This is only used to detect jump and branch back to the same
+            // instruction, i.e. infinite loop.
+            uint16_t pc_old = m_pc;
+
+            // Decoding may split off lanes, but never the first active one.
+            const Cpu65C02::t_decoded& d = decode(m_pc);
+            m_count += 1;
+            if (!m_masked)
+                execute(d);
+            else {
+                // Only the lanes in the group change.
+                alignas(16) uint8_t active[LANES], areg[LANES], xreg[LANES], yreg[LANES], sp[LANES], flags[LANES];
+                std::copy(m_active, m_active + LANES, active);
+                std::copy(m_areg, m_areg + LANES, areg);
+                std::copy(m_xreg, m_xreg + LANES, xreg);
+                std::copy(m_yreg, m_yreg + LANES, yreg);
+                std::copy(m_sp, m_sp + LANES, sp);
+                std::copy(m_flags, m_flags + LANES, flags);
+                execute(d);
+                for (unsigned l = 0; l < LANES; ++l)
+                {
+                    m_areg[l]  = active[l] ? m_areg[l] : areg[l];
+                    m_xreg[l]  = active[l] ? m_xreg[l] : xreg[l];
+                    m_yreg[l]  = active[l] ? m_yreg[l] : yreg[l];
+                    m_sp[l]    = active[l] ? m_sp[l] : sp[l];
+                    m_flags[l] = active[l] ? m_flags[l] : flags[l];
+                }
+            }
+
+            if (m_stop) {
+                uint32_t hit = m_stop & stopMask;
+                m_stop = 0;
+                if (hit) {
+                    for (unsigned l = 0; l < LANES; ++l)
+                        if (m_active[l])
+                            finish(l, (Cpu65C02::t_stopReason) (hit & -hit));
+                    break;
+                }
+            }
+
+            // Lanes sent elsewhere wait there, unless they jumped to
+            // themselves.
+            for (unsigned l = 0; m_split && l < LANES; ++l)
+            {
+                if (!m_diverged[l])
+                    continue;
+                if (m_lanePc[l] == pc_old && (stopMask & Cpu65C02::STOP_SELF_JUMP))
+                    finish(l, Cpu65C02::STOP_SELF_JUMP);
+                else
+                    leave(l);
+            }
+            m_split = false;
+
+            if (pc_old == m_pc && (stopMask & Cpu65C02::STOP_SELF_JUMP)) {
+                for (unsigned l = 0; l < LANES; ++l)
+                    if (m_active[l])
+                        finish(l, Cpu65C02::STOP_SELF_JUMP);
+                break;
+            }
+
+            // There are no interrupts to wake up from WAI.
+            if (m_waiting) {
+                m_waiting = false;
+                for (unsigned l = 0; l < LANES; ++l)
+                    if (m_active[l])
+                        finish(l, count(l) == budget ? Cpu65C02::STOP_BUDGET : Cpu65C02::STOP_WAIT);
+                break;
+            }
+
+            // Another group is due, or waiting here to join this one.
+            if (m_waitingAt[m_pc] || priority(m_sp[m_first], m_pc) > m_minWaiting)
+                break;
+
+            // The scalar CPU is faster for a few lanes that have been on
+            // their own for a while.
+            if (m_size <= LANES/4 && m_count >= soloInstructions) {
+                for (unsigned l = 0; l < LANES; ++l)
+                    if (m_active[l])
+                        split(l);
+                break;
+            }
+        }
+
+        for (unsigned l = 0; l < LANES; ++l)
+            if (m_active[l])
+                leave(l);
+    }
+
+    // Then run the lanes that were split off.
+    for (unsigned l = 0; l < LANES; ++l)
+    {
+        t_scalar& scalar = m_scalar[l];
+        if (!scalar.cpu)
+            continue;
+
+        t_result& result = m_results[l];
+        result.reason       = scalar.cpu->run(budget - scalar.instructions, stopMask);
+        result.registers    = scalar.cpu->getRegisters();
+        result.instructions = scalar.instructions + scalar.cpu->instructionCount();
+        result.scalar       = true;
+    }
+} // run
+
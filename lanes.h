@@ -0,0 +1,137 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "cpu65c02.h"
+
+// Runs many copies of the same program in lockstep, e.g. for differential
+// fuzzing where only the input data differs between the copies.
+//
+// The state of the copies ("lanes") is kept as a structure of arrays: one
+// array per register, and a memory where the same address of all lanes is
+// stored contiguously. Each instruction is fetched and decoded only once,
+// and is then executed for all lanes by short loops that the compiler turns
+// into vector instructions (16 lanes of bytes fill one SSE2 register).
+//
+// The lanes are grouped by Program Counter, and one group runs while the
+// other lanes keep their state: the one deepest in subroutines, and then at
+// the lowest address. When a branch, return or indirect jump sends some
+// lanes of the group elsewhere, they wait, and the lanes are grouped again
+// when the running group gets to a waiting lane, or goes past the first of
+// them. So lanes that took different ways through an if, or out of a loop,
+// run together again where the ways meet.
+// Lanes whose instruction bytes differ from the others, and small groups
+// that have run on their own for a while, are split off for good and
+// finished by separate scalar Cpu65C02s, which are faster for a few lanes. The
+// results are identical to running every lane on its own Cpu65C02.
+//
+// All memory is RAM. Interrupts, breakpoints, tracing and clock cycles are
+// not supported.
+class CpuLanes
+{
+    public:
+        static const unsigned LANES = 16;   // Must be a power of two.
+
+        typedef struct {
+            Cpu65C02::t_registers registers;    // When the lane stopped.
+            Cpu65C02::t_stopReason reason;
+            uint64_t instructions;
+            bool     scalar;        // Split off from the lockstep group.
+        } t_result;
+
+        // Every lane starts with the image loaded at the top of memory,
+        // and the registers after reset.
+        CpuLanes(const std::vector<uint8_t>& rom);
+        ~CpuLanes();
+
+        // Give each lane its own input before calling run().
+        void setRegisters(unsigned lane, const Cpu65C02::t_registers& regs);
+        void poke(unsigned lane, uint16_t addr, uint8_t value) {m_mem[index(lane, addr)] = value;}
+
+        // Executes up to budget instructions in every lane, and returns
+        // when all lanes have stopped.
+        void run(uint64_t budget, uint32_t stopMask = Cpu65C02::STOP_ALL);
+
+        // The state after run().
+        const t_result& result(unsigned lane) const {return m_results[lane];}
+        uint8_t peek(unsigned lane, uint16_t addr) const;
+
+        // Instructions executed in lockstep, counted once per lane.
+        uint64_t lockstepInstructions() const {return m_lockstep;}
+
+    private:
+        // A group of at most LANES/4 lanes that has run this many
+        // instructions without meeting another one is split off.
+        static const unsigned soloInstructions = 64;
+
+        // A lane that has left the lockstep group.
+        typedef struct {
+            std::unique_ptr<Memory>   memory;
+            std::unique_ptr<Cpu65C02> cpu;
+            uint64_t instructions;  // Executed before the split.
+        } t_scalar;
+
+        std::vector<uint8_t> m_mem;     // Interleaved, see index().
+        std::vector<uint8_t> m_code;    // Non-zero if the byte is in m_decoded.
+        std::vector<Cpu65C02::t_decoded> m_decoded; // Indexed by the Program Counter.
+
+        // The lockstep group.
+        uint16_t m_pc;
+        alignas(16) uint8_t m_areg[LANES];
+        alignas(16) uint8_t m_xreg[LANES];
+        alignas(16) uint8_t m_yreg[LANES];
+        alignas(16) uint8_t m_sp[LANES];
+        alignas(16) uint8_t m_flags[LANES];     // The status register, bits as Cpu65C02::FLAG_C etc.
+        alignas(16) uint8_t m_active[LANES];    // Non-zero if the lane is in the group.
+        uint8_t  m_alive[LANES];    // Non-zero until the lane stops or is split off.
+        unsigned m_size;            // Lanes in the group.
+        bool     m_masked;          // Some lanes are not in the group.
+        bool     m_split;           // Some lanes of the group were sent elsewhere.
+        uint64_t m_count;           // Instructions executed by the group.
+        uint32_t m_stop;
+        bool     m_waiting;         // After WAI.
+
+        // Instructions executed by each lane before the current group.
+        uint64_t m_laneCount[LANES];
+        unsigned m_first;           // A lane in the group.
+        uint32_t m_minWaiting;      // The best priority() of a lane not in the group.
+        std::vector<uint8_t> m_waitingAt;   // Non-zero where a lane may be waiting.
+
+        // Per-lane Program Counters outside the group, and effective addresses.
+        uint16_t m_lanePc[LANES];
+        uint8_t  m_diverged[LANES];
+        alignas(16) uint16_t m_addr[LANES];
+        bool     m_uniform;         // All lanes use m_addr[0].
+
+        std::vector<t_scalar> m_scalar; // Indexed by lane.
+        std::vector<t_result> m_results;
+        uint64_t m_lockstep;
+
+        static size_t index(unsigned lane, uint16_t addr) {return (size_t) addr * LANES + lane;}
+
+        // Lanes deeper in subroutines run first, so that they return to
+        // the others, and then those at the lowest address, so that the
+        // lanes behind catch up. Lower is first.
+        static uint32_t priority(uint8_t sp, uint16_t pc) {return ((uint32_t) sp << 16) | pc;}
+
+        const Cpu65C02::t_decoded& decode(uint16_t addr);
+        void execute(const Cpu65C02::t_decoded& d);
+
+        void address(const Cpu65C02::t_decoded& d);
+        void read16(uint16_t* result, const uint16_t* addr);
+        void load(uint8_t* value);
+        void store(const uint8_t* value);
+        void alu(uint8_t op, uint8_t* result, const uint8_t* arg1, const uint8_t* arg2);
+        void branch(const uint8_t* taken, uint16_t target);
+        void jump(const uint16_t* pc);
+        void invalidate(uint16_t addr);
+
+        Cpu65C02::t_registers registers(unsigned lane) const;
+        uint64_t count(unsigned lane) const {return m_laneCount[lane] + (m_active[lane] ? m_count : 0);}
+        bool group(uint64_t budget, uint64_t& remaining);
+        unsigned firstActive() const;
+        void leave(unsigned lane);
+        void split(unsigned lane);
+        void finish(unsigned lane, Cpu65C02::t_stopReason reason);
+}; // end of class CpuLanes
+
@@ -1,23 +1,364 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include "disas.h"
 #include "memory.h"
 #include "cpu65c02.h"
+#include "farm.h"
+#include "fuzz.h"
+#include "image.h"
+#include "lanes.h"
+#include "profile.h"
+#include "jit.h"
+#ifdef ENGINE_AOT
+#include "aot.h"
+#endif
+#include "trace.h"
+#include "tracestream.h"
 
-int main()
+// Run many copies of the ROM in parallel, and report the throughput. A
+// read-only image is shared by all of them.
+static int runFarm(const RomImage& image, bool readOnly, Cpu65C02::t_variant variant, unsigned copies, unsigned threads)
 {
-    // Read ROM contents from binary file.
-    std::ifstream stream("rom.bin", std::ios::in | std::ios::binary);
-    std::vector<uint8_t> initial((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    std::vector<uint8_t> rom = image.contents();
+    Farm::t_job job = {};
+    job.rom      = &rom;
+    job.image    = readOnly ? &image : 0;
+    job.budget   = 100000000;
+    job.stopMask = Cpu65C02::STOP_SELF_JUMP | Cpu65C02::STOP_ILLEGAL;
+    job.variant  = variant;
+
+    Farm farm(threads);
+    std::vector<Farm::t_result> results = farm.run(std::vector<Farm::t_job>(copies, job));
+
+    unsigned passed = 0;
+    for (const Farm::t_result& result : results)
+        if (result.reason == Cpu65C02::STOP_SELF_JUMP)
+            ++passed;
+
+    std::cout << passed << " of " << copies << " jobs ended in an infinite loop" << std::endl;
+    std::cout << farm.instructions() << " instructions in " << farm.seconds() << " seconds, ";
+    std::cout << farm.instructionsPerSecond() / 1e6 << " million instructions per second" << std::endl;
+
+    return (passed == copies) ? 0 : 1;
+} // runFarm
+
+// Run many copies of the ROM in lockstep, and report the throughput.
+static int runLanes(const std::vector<uint8_t>& rom, unsigned copies)
+{
+    const uint32_t stopMask = Cpu65C02::STOP_SELF_JUMP | Cpu65C02::STOP_ILLEGAL;
+    uint64_t instructions = 0;
+    unsigned passed = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned done = 0; done < copies; done += CpuLanes::LANES)
+    {
+        CpuLanes lanes(rom);
+        lanes.run(100000000, stopMask);
+        for (unsigned l = 0; l < CpuLanes::LANES && done + l < copies; ++l)
+        {
+            instructions += lanes.result(l).instructions;
+            if (lanes.result(l).reason == Cpu65C02::STOP_SELF_JUMP)
+                ++passed;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << passed << " of " << copies << " lanes ended in an infinite loop" << std::endl;
+    std::cout << instructions << " instructions in " << seconds << " seconds, ";
+    std::cout << instructions / seconds / 1e6 << " million instructions per second" << std::endl;
+
+    return (passed == copies) ? 0 : 1;
+} // runLanes
+
+// Run the ROM with the profiler, print the report, write the call stacks
+// to profile.folded for a flame graph, and the hottest instruction pairs
+// to profile.fusion.h (see "make fusion").
+static int runProfile(const RomImage& image, bool readOnly, Cpu65C02::t_variant variant, int symbolFiles, char* fileNames[])
+{
+    Symbols symbols;
+    for (int i = 0; i < symbolFiles; ++i)
+        if (!symbols.load(fileNames[i]))
+            std::cerr << "Can not read " << fileNames[i] << std::endl;
+
+    Memory mem;
+    image.install(mem, readOnly);
+    Cpu65C02 cpu(mem, variant);
+    Profiler profiler;
+    cpu.setProfiler(&profiler);
+
+    const uint32_t stopMask = Cpu65C02::STOP_SELF_JUMP | Cpu65C02::STOP_ILLEGAL;
+    Cpu65C02::t_stopReason reason = cpu.run(1000000000, stopMask);
+
+    profiler.report(std::cout, mem, symbols);
+    std::ofstream folded("profile.folded");
+    profiler.folded(folded, symbols);
+    std::ofstream fusion("profile.fusion.h");
+    profiler.fusion(fusion);
+
+    return (reason == Cpu65C02::STOP_SELF_JUMP) ? 0 : 1;
+} // runProfile
+
+// Fuzz a routine of the ROM with the built-in fuzzer. The arguments are
+// options for Fuzzer::parse(), "runs=n", "seed=n", and files with inputs
+// to start from. The crashes are written to crash-1.bin etc.
+static int runFuzzer(const RomImage& image, bool readOnly, Cpu65C02::t_variant variant, int argc, char* argv[])
+{
+    Fuzzer::t_config config = Fuzzer::defaultConfig();
+    uint64_t runs = 1000000;
+    uint32_t seed = 1;
+    std::vector<std::vector<uint8_t> > inputs;
+    for (int i = 0; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "runs=", 5) == 0)
+            runs = strtoull(argv[i] + 5, 0, 10);
+        else if (strncmp(argv[i], "seed=", 5) == 0)
+            seed = strtoul(argv[i] + 5, 0, 10);
+        else if (!Fuzzer::parse(argv[i], config)) {
+            std::ifstream file(argv[i], std::ios::in | std::ios::binary);
+            if (!file) {
+                std::cerr << "Can not read " << argv[i] << std::endl;
+                return 1;
+            }
+            inputs.push_back(std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()));
+        }
+    }
+
+    Memory mem;
+    image.install(mem, readOnly);
+    Cpu65C02 cpu(mem, variant);
+    Coverage coverage(Fuzzer::mapSize);
+    Fuzzer fuzzer(cpu, mem, coverage, config);
+    if (!fuzzer.boot()) {
+        std::cerr << "The entry at " << std::hex << config.entry << " is not reached" << std::endl;
+        return 1;
+    }
+    for (const auto& input : inputs)
+        fuzzer.addInput(input);
+
+    auto start = std::chrono::steady_clock::now();
+    fuzzer.fuzz(runs, seed);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << fuzzer.runs() << " runs in " << seconds << " seconds, " << fuzzer.runs() / seconds << " per second" << std::endl;
+    std::cout << fuzzer.corpus().size() << " inputs in the corpus, " << fuzzer.hangs() << " hangs, ";
+    std::cout << fuzzer.crashes().size() << " crashes" << std::endl;
+    for (size_t i = 0; i < fuzzer.crashes().size(); ++i)
+    {
+        std::ofstream file("crash-" + std::to_string(i + 1) + ".bin", std::ios::out | std::ios::binary);
+        file.write((const char*) fuzzer.crashes()[i].data(), fuzzer.crashes()[i].size());
+    }
+    return fuzzer.crashes().empty() ? 0 : 1;
+} // runFuzzer
+
+// List the code reachable from the vectors, with labels from the symbol files.
+static int runDisassembler(const RomImage& image, int symbolFiles, char* fileNames[])
+{
+    Symbols symbols;
+    for (int i = 0; i < symbolFiles; ++i)
+        if (!symbols.load(fileNames[i]))
+            std::cerr << "Can not read " << fileNames[i] << std::endl;
+
+    listing(std::cout, image.contents().data(), symbols);
+    return std::cout.good() ? 0 : 1;
+} // runDisassembler
+
+// Load the images given at the start of the command line, and remove those
+// options from it:
+//   -rom file[@address]   A raw binary, by default ending at $FFFF.
+//   -hex file             Intel HEX.
+//   -ld65 file map        ld65 output, placed according to its map file.
+//   -writable             Copy the images into RAM instead of mapping them as ROM.
+// Without any images, rom.bin is loaded into RAM.
+static bool loadImages(RomImage& image, bool& readOnly, int& argc, char**& argv)
+{
+    readOnly = true;
+    while (argc >= 2)
+    {
+        bool loaded;
+        int used = 2;
+        if (strcmp(argv[1], "-writable") == 0) {
+            readOnly = false;
+            loaded = true;
+            used = 1;
+        } else if (argc >= 3 && strcmp(argv[1], "-rom") == 0) {
+            std::string fileName = argv[2];
+            size_t at = fileName.rfind('@');
+            int32_t address = -1;
+            if (at != std::string::npos) {
+                address = strtol(fileName.c_str() + at + 1, 0, 16);
+                fileName.resize(at);
+            }
+            loaded = image.loadBinary(fileName, address);
+        } else if (argc >= 3 && strcmp(argv[1], "-hex") == 0) {
+            loaded = image.loadHex(argv[2]);
+        } else if (argc >= 4 && strcmp(argv[1], "-ld65") == 0) {
+            loaded = image.loadLd65(argv[2], argv[3]);
+            used = 3;
+        } else
+            break;
+
+        if (!loaded) {
+            std::cerr << "Can not load " << argv[2] << std::endl;
+            return false;
+        }
+        argc -= used;
+        argv += used;
+    }
+
+    // The 6502 functional test modifies its own code, so rom.bin is
+    // loaded into RAM.
+    if (image.empty()) {
+        readOnly = false;
+        if (!image.loadBinary("rom.bin")) {
+            std::cerr << "Can not load rom.bin" << std::endl;
+            return false;
+        }
+    }
+    return true;
+} // loadImages
+
+// The CPU to emulate, chosen by "-cpu 65c02", "-cpu r65c02" or "-cpu 6502"
+// after the images. The default is the 65C02.
+static bool chooseVariant(Cpu65C02::t_variant& variant, int& argc, char**& argv)
+{
+    variant = Cpu65C02::CPU_65C02;
+    if (argc < 3 || strcmp(argv[1], "-cpu") != 0)
+        return true;
+
+    if (strcmp(argv[2], "65c02") == 0)
+        variant = Cpu65C02::CPU_65C02;
+    else if (strcmp(argv[2], "r65c02") == 0)
+        variant = Cpu65C02::CPU_R65C02;
+    else if (strcmp(argv[2], "6502") == 0)
+        variant = Cpu65C02::CPU_6502;
+    else {
+        std::cerr << "Unknown CPU " << argv[2] << ", expected 65c02, r65c02 or 6502" << std::endl;
+        return false;
+    }
+    argc -= 2;
+    argv += 2;
+    return true;
+} // chooseVariant
+
+int main(int argc, char* argv[])
+{
+    RomImage image;
+    bool readOnly;
+    Cpu65C02::t_variant variant;
+    if (!loadImages(image, readOnly, argc, argv) || !chooseVariant(variant, argc, argv))
+        return 1;
+
+    // "cpu65c02 -farm copies [threads]" benchmarks the farm instead.
+    if (argc >= 3 && strcmp(argv[1], "-farm") == 0)
+        return runFarm(image, readOnly, variant, atoi(argv[2]), (argc >= 4) ? atoi(argv[3]) : 0);
+
+    // "cpu65c02 -lanes copies" runs them in lockstep on a single core.
+    if (argc >= 3 && strcmp(argv[1], "-lanes") == 0) {
+        if (variant != Cpu65C02::CPU_65C02) {
+            std::cerr << "The lanes only emulate the 65C02" << std::endl;
+            return 1;
+        }
+        return runLanes(image.contents(), atoi(argv[2]));
+    }
+
+    // "cpu65c02 -profile [map or label files]" reports where the time goes.
+    if (argc >= 2 && strcmp(argv[1], "-profile") == 0)
+        return runProfile(image, readOnly, variant, argc - 2, argv + 2);
+
+    // "cpu65c02 -disas [map or label files]" lists the code in the ROM.
+    if (argc >= 2 && strcmp(argv[1], "-disas") == 0)
+        return runDisassembler(image, argc - 2, argv + 2);
+
+    // "cpu65c02 -fuzz entry=addr input=addr ..." fuzzes a routine of the ROM.
+    if (argc >= 2 && strcmp(argv[1], "-fuzz") == 0)
+        return runFuzzer(image, readOnly, variant, argc - 2, argv + 2);
+
+    // "cpu65c02 -stream file" also writes the complete trace to file.
+    const char* streamFile = (argc >= 3 && strcmp(argv[1], "-stream") == 0) ? argv[2] : 0;
+#if defined(ENGINE_JIT) || defined(ENGINE_AOT)
+    if (streamFile) {
+        std::cerr << "There is no instruction trace with this engine" << std::endl;
+        return 1;
+    }
+#endif
 
     // Initialize memory and CPU
-    Memory mem(initial);
-    Cpu65C02 cpu65c02(mem);
+    std::cout << "Initializing memory with " << image.size() << " bytes" << std::endl;
+    Memory mem;
+    image.install(mem, readOnly);
+    Cpu65C02 cpu65c02(mem, variant);
+    std::cout << "Resetting CPU. PC=" << std::hex << std::setw(4) << cpu65c02.getRegisters().pc;
+    std::cout << std::dec << std::endl;
 
-    // Go into an infinite loop.
     // The program will terminate, when a JMP or B?? instruction jumps to itself.
-    while (true)
+    // The functional tests execute BRK, so that must not stop the program.
+    const uint32_t stopMask = Cpu65C02::STOP_SELF_JUMP | Cpu65C02::STOP_ILLEGAL | Cpu65C02::STOP_BREAKPOINT | Cpu65C02::STOP_STP;
+    Cpu65C02::t_stopReason reason;
+
+#ifdef ENGINE_JIT
+    // Translate to native code. There is no instruction trace in this mode.
+    CpuJit jit(cpu65c02);
+    do {
+        reason = jit.run(1000000, stopMask);
+    } while (reason == Cpu65C02::STOP_BUDGET);
+#elif defined(ENGINE_AOT)
+    // The ROM compiled by romcc. There is no instruction trace in this mode.
+    CpuAot aot(cpu65c02);
+    do {
+        reason = aot.run(1000000, stopMask);
+    } while (reason == Cpu65C02::STOP_BUDGET);
+#else
+    // The last million instructions are kept, and saved to trace.bin when the
+    // program terminates. Use tracedump to convert it to text.
+    Trace trace(1 << 20);
+    mem.setTrace(&trace);
+    cpu65c02.setTrace(&trace);
+
+    // The stream is compressed and written by a thread of its own.
+    std::unique_ptr<TraceWriter> writer;
+    if (streamFile) {
+        writer.reset(new TraceWriter(trace, streamFile));
+        if (!writer->good()) {
+            std::cerr << "Can not write " << streamFile << std::endl;
+            return 1;
+        }
+    }
+
+    do {
+        reason = cpu65c02.run(1000000, stopMask);
+    } while (reason == Cpu65C02::STOP_BUDGET);
+
+    trace.save("trace.bin");
+    if (writer) {
+        if (!writer->finish())
+            std::cerr << "Error writing " << streamFile << std::endl;
+        std::cerr << writer->records() << " instructions streamed in " << writer->bytes() << " bytes";
+        if (writer->dropped())
+            std::cerr << ", " << writer->dropped() << " blocks dropped";
+        std::cerr << std::endl;
+    }
+#endif
+
+    switch (reason)
     {
-        cpu65c02.show();
-        cpu65c02.singleStep();
+        case Cpu65C02::STOP_SELF_JUMP  : std::cerr << "Infinite loop!" << std::endl; break;
+        case Cpu65C02::STOP_ILLEGAL    : std::cerr << "Unimplemented instruction" << std::endl; break;
+        case Cpu65C02::STOP_BREAKPOINT : std::cerr << "Breakpoint" << std::endl; break;
+        case Cpu65C02::STOP_STP        : std::cerr << "Stopped by STP" << std::endl; break;
+        default : break;
     }
+    std::cerr << std::dec << cpu65c02.instructionCount() << " instructions executed";
+#ifndef NO_CYCLES
+    std::cerr << " in " << cpu65c02.cycleCount() << " clock cycles";
+#endif
+    std::cerr << std::endl;
+
+    return (reason == Cpu65C02::STOP_SELF_JUMP) ? 0 : 1;
 } // main
 
@@ -1,40 +1,424 @@
 #pragma once
 
-#include <iostream>
-#include <iomanip>
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <stdint.h>
+#include "trace.h"
 
+// Interface for anyone keeping a copy of (part of) the memory contents,
+// e.g. the pre-decoded instruction cache of the CPU.
+class MemoryObserver
+{
+    public:
+        virtual ~MemoryObserver() {}
+
+        // Called when a byte previously marked with Memory::watch() is written.
+        virtual void invalidate(uint16_t addr) = 0;
+
+        // Called when a watchpoint is hit, after the access.
+        virtual void watchpoint(uint16_t addr, bool write) {(void) addr; (void) write;}
+}; // end of class MemoryObserver
+
+// Interface for memory-mapped I/O.
+class Device
+{
+    public:
+        virtual ~Device() {}
+
+        virtual uint8_t read(uint16_t addr) = 0;
+        virtual void write(uint16_t addr, uint8_t value) = 0;
+
+        // Return true if reading addr a second time gives the same value
+        // and has no further effect, as long as there is no write and no
+        // scheduled event in between. The CPU may then skip over loops
+        // that poll the address.
+        virtual bool stableRead(uint16_t addr) const {(void) addr; return false;}
+}; // end of class Device
+
+// Interface for recording the values read from devices, so that they can
+// be played back later without the devices (see Recorder).
+class InputLog
+{
+    public:
+        virtual ~InputLog() {}
+
+        // Called instead of the device functions.
+        virtual uint8_t read(Device& device, uint16_t addr) = 0;
+        virtual void write(Device& device, uint16_t addr, uint8_t value) = 0;
+}; // end of class InputLog
+
+// The 64 KB address space is divided into 256 pages of 256 bytes, each of
+// which is either RAM, ROM or I/O.
+//
+// RAM and ROM pages are accessed directly through a pointer. Writes to ROM
+// pages go to a scratch page and are lost. Only the pages without a pointer
+// take the slow path: I/O pages, RAM pages containing cached instructions,
+// pages with watchpoints, and all pages while a trace is recorded.
+//
+// Once a snapshot has been taken, RAM pages also take the slow path until
+// their first write, which marks them dirty. Restoring the same snapshot
+// again only has to copy back the dirty pages.
 class Memory
 {
     public:
-        Memory(std::vector<uint8_t> init) : m_trace(false) {m_data.reserve(65536);
-            std::cout << "Initializing memory with " << init.size() << " bytes" << std::endl;
-            std::copy(init.begin(), init.end(), &m_data[65536-init.size()]);
+        // The initial contents are placed at the top of memory.
+        Memory(const std::vector<uint8_t>& init = std::vector<uint8_t>()) : m_data(65536, 0), m_code(65536, 0), m_watch(65536, 0),
+            m_tracer(0), m_observer(0), m_inputLog(0), m_volatileReads(0),
+            m_tracking(false), m_baseline(0), m_restored(0), m_watchpoints(0)
+        {
+            std::fill(m_dirty, m_dirty + 256, 1);
+            std::fill(m_readWatches, m_readWatches + 256, 0);
+            std::fill(m_writeWatches, m_writeWatches + 256, 0);
+            std::copy(init.begin(), init.end(), m_data.end() - init.size());
+            for (unsigned page = 0; page < 256; ++page)
+                m_pageData[page] = &m_data[page*256];
+            mapRam(0x00, 0xFF);
         }
 
         // Memory access is one byte at a time.
-        uint8_t read(uint16_t addr) const {
-            if (m_trace) {
-                std::cout << "Reading value " << std::hex << std::setw(2) << std::setfill('0') << (uint16_t) m_data[addr];
-                std::cout << " from address " << std::hex << std::setw(4) << std::setfill('0') << addr << std::dec << std::endl;
-            }
-                
-            return m_data[addr];
+        uint8_t read(uint16_t addr) {
+            const uint8_t* page = m_readPage[addr >> 8];
+            if (page)
+                return page[addr & 0xFF];
+            return readSlow(addr);
         }
         void write(uint16_t addr, uint8_t value) {
-            if (m_trace) {
-                std::cout << "Writing value " << std::hex << std::setw(2) << std::setfill('0') << (uint16_t) value;
-                std::cout << " to address " << std::hex << std::setw(4) << std::setfill('0') << addr << std::dec << std::endl;
-            }
-            m_data[addr] = value;
+            uint8_t* page = m_writePage[addr >> 8];
+            if (page)
+                page[addr & 0xFF] = value;
+            else
+                writeSlow(addr, value);
         }
 
-        void trace(bool enable) {m_trace = enable;}
+        // Read without side effects, and without being traced.
+        // I/O pages are not accessed.
+        uint8_t peek(uint16_t addr) const {return m_pageData[addr >> 8][addr & 0xFF];}
+
+        // Copy data into memory at addr, e.g. to load a program. Devices
+        // are not written, and neither are mapped images.
+        void load(uint16_t addr, const uint8_t* data, size_t size);
+
+        // Configure a range of pages, e.g. mapRom(0xC0, 0xFF) for $C000-$FFFF.
+        void mapRam(uint8_t first, uint8_t last)    {map(first, last, PAGE_RAM, 0);}
+        void mapRom(uint8_t first, uint8_t last)    {map(first, last, PAGE_ROM, 0);}
+        void mapDevice(uint8_t first, uint8_t last, Device* device) {map(first, last, PAGE_IO, device);}
+
+        // Map pages as ROM, read straight from data outside, which must stay
+        // valid. Many instances can share one copy of an image this way,
+        // e.g. a file mapped by RomImage (image.h). Mapping the pages as RAM
+        // or ROM again copies the image into them.
+        void mapImage(uint8_t first, uint8_t last, const uint8_t* data);
+
+        // Record all memory accesses. Set to null to stop recording.
+        void setTrace(Trace* tracer);
+
+        // Any subsequent write to this address will be reported to the observer.
+        void watch(uint16_t addr);
+        void setObserver(MemoryObserver* observer) {m_observer = observer;}
+
+        // Report reads and/or writes of addr to the observer (instruction
+        // fetches are not data reads). Zero removes the watchpoint.
+        enum {WATCH_READ = 1, WATCH_WRITE = 2};
+        void setWatchpoint(uint16_t addr, uint8_t kinds);
+        uint8_t watchpoint(uint16_t addr) const {return m_watch[addr];}
+        unsigned watchpointCount() const {return m_watchpoints;}
+
+        // Route all device accesses through the log. Set to null to stop.
+        void setInputLog(InputLog* log) {m_inputLog = log;}
+
+        // Number of reads so far from devices without stableRead().
+        uint64_t volatileReads() const {return m_volatileReads;}
+
+        // Copy the whole 64 KB to image, and start tracking the pages
+        // written from now on. The id identifies the image contents, and
+        // must be a new one from newId() whenever they change.
+        void save(uint8_t* image, uint64_t id);
+        static uint64_t newId() {
+            static std::atomic<uint64_t> next(1);
+            return next++;
+        }
+
+        // Copy image back. When it is the image last saved or restored (the
+        // same id), only the pages written since then are copied. I/O pages
+        // and mapped images are skipped, and the page mapping is left as it is.
+        void restore(const uint8_t* image, uint64_t id);
+
+        // Copy the pages written since image was last saved or restored
+        // into it, and return their numbers. All pages are copied if the
+        // memory has been synced with another image (id) in between.
+        std::vector<uint8_t> update(uint8_t* image, uint64_t id);
+
+        // Number of pages copied by the last restore().
+        unsigned restoredPages() const {return m_restored;}
 
     private:
+        typedef enum {PAGE_RAM, PAGE_ROM, PAGE_IO} t_pageType;
+
         std::vector<uint8_t> m_data;
-        bool m_trace;
+        std::vector<uint8_t> m_code;    // Non-zero if the byte is cached by the observer.
+        std::vector<uint8_t> m_watch;   // WATCH_READ and WATCH_WRITE.
+
+        const uint8_t* m_pageData[256]; // Where the contents of each page are.
+        const uint8_t* m_readPage[256]; // Null if the slow path must be taken.
+        uint8_t*   m_writePage[256];    // Null if the slow path must be taken.
+        t_pageType m_pageType[256];
+        Device*    m_device[256];
+        uint16_t   m_codeCount[256];    // Number of watched bytes in each page.
+        uint8_t    m_discard[256];      // Writes to ROM end up here.
+        uint8_t    m_dirty[256];        // Written since the last save() or restore().
+        uint16_t   m_readWatches[256];  // Number of watchpoints in each page.
+        uint16_t   m_writeWatches[256];
+
+        Trace* m_tracer;
+        MemoryObserver* m_observer;
+        InputLog* m_inputLog;
+        uint64_t m_volatileReads;
+        bool     m_tracking;            // Dirty pages are tracked.
+        uint64_t m_baseline;            // Id of the image memory was last synced with.
+        unsigned m_restored;
+        unsigned m_watchpoints;
+
+        void map(uint8_t first, uint8_t last, t_pageType type, Device* device, const uint8_t* data = 0);
+        bool mapped(uint8_t page) const {return m_pageData[page] != &m_data[page*256];}
+        void updatePage(uint8_t page);
+        uint8_t readSlow(uint16_t addr);
+        void writeSlow(uint16_t addr, uint8_t value);
+        void track(uint64_t id);
 }; // end of class Memory
 
+inline void Memory::map(uint8_t first, uint8_t last, t_pageType type, Device* device, const uint8_t* data)
+{
+    for (unsigned page = first; page <= last; ++page)
+    {
+        // A page leaving an image keeps its contents, as if it had been
+        // copied into RAM.
+        if (!data && mapped(page)) {
+            std::copy(m_pageData[page], m_pageData[page] + 256, &m_data[page*256]);
+            m_dirty[page] = 1;
+        }
+        m_pageType[page]  = type;
+        m_device[page]    = device;
+        m_pageData[page]  = data ? data + (page - first)*256 : &m_data[page*256];
+        m_codeCount[page] = 0;
+        for (unsigned i = 0; i < 256; ++i)
+        {
+            if (m_code[page*256 + i])
+            {
+                // Report the byte as modified, since it may now read differently.
+                m_code[page*256 + i] = 0;
+                if (m_observer)
+                    m_observer->invalidate(page*256 + i);
+            }
+        }
+        updatePage(page);
+    }
+} // map
+
+inline void Memory::mapImage(uint8_t first, uint8_t last, const uint8_t* data)
+{
+    // Instructions cached from ROM are not watched, so every byte that
+    // changes is reported.
+    for (unsigned addr = first*256; addr < (last + 1u)*256; ++addr)
+        if (!m_code[addr] && m_observer && peek(addr) != data[addr - first*256])
+            m_observer->invalidate(addr);
+    map(first, last, PAGE_ROM, 0, data);
+} // mapImage
+
+inline void Memory::load(uint16_t addr, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint16_t dest = addr + i;
+        uint8_t  page = dest >> 8;
+        if (m_pageType[page] == PAGE_IO || mapped(page) || m_data[dest] == data[i])
+            continue;
+
+        if (m_code[dest]) {
+            m_code[dest] = 0;
+            if (--m_codeCount[page] == 0)
+                updatePage(page);
+            m_observer->invalidate(dest);
+        } else if (m_pageType[page] == PAGE_ROM && m_observer)
+            m_observer->invalidate(dest);
+        m_data[dest] = data[i];
+        if (!m_dirty[page]) {
+            m_dirty[page] = 1;
+            updatePage(page);
+        }
+    }
+} // load
+
+// Decide whether the page can be accessed directly.
+inline void Memory::updatePage(uint8_t page)
+{
+    bool direct = (m_tracer == 0) && (m_pageType[page] != PAGE_IO);
+
+    m_readPage[page]  = (direct && m_readWatches[page] == 0) ? m_pageData[page] : 0;
+    m_writePage[page] = 0;
+    if (m_writeWatches[page])
+        return;
+    if (direct && m_pageType[page] == PAGE_ROM)
+        m_writePage[page] = m_discard;
+    else if (direct && m_codeCount[page] == 0 && m_dirty[page])
+        m_writePage[page] = &m_data[page*256];
+} // updatePage
+
+inline void Memory::setTrace(Trace* tracer)
+{
+    m_tracer = tracer;
+    for (unsigned page = 0; page < 256; ++page)
+        updatePage(page);
+} // setTrace
+
+inline void Memory::watch(uint16_t addr)
+{
+    uint8_t page = addr >> 8;
+
+    // ROM can not change, and I/O is never cached.
+    if (m_pageType[page] != PAGE_RAM || m_code[addr])
+        return;
+
+    m_code[addr] = 1;
+    if (m_codeCount[page]++ == 0)
+        updatePage(page);
+} // watch
+
+inline void Memory::setWatchpoint(uint16_t addr, uint8_t kinds)
+{
+    uint8_t page = addr >> 8;
+    uint8_t old  = m_watch[addr];
+    m_readWatches[page]  += ((kinds & WATCH_READ)  != 0) - ((old & WATCH_READ)  != 0);
+    m_writeWatches[page] += ((kinds & WATCH_WRITE) != 0) - ((old & WATCH_WRITE) != 0);
+    m_watchpoints += (kinds != 0) - (old != 0);
+    m_watch[addr] = kinds;
+    updatePage(page);
+} // setWatchpoint
+
+inline uint8_t Memory::readSlow(uint16_t addr)
+{
+    uint8_t page = addr >> 8;
+    uint8_t value = m_pageData[page][addr & 0xFF];
+    if (m_pageType[page] == PAGE_IO) {
+        value = m_inputLog ? m_inputLog->read(*m_device[page], addr) : m_device[page]->read(addr);
+        if (!m_device[page]->stableRead(addr))
+            m_volatileReads += 1;
+    }
+
+    if (m_tracer)
+        m_tracer->access(addr, value, false);
+    if ((m_watch[addr] & WATCH_READ) && m_observer)
+        m_observer->watchpoint(addr, false);
+    return value;
+} // readSlow
+
+inline void Memory::writeSlow(uint16_t addr, uint8_t value)
+{
+    uint8_t page = addr >> 8;
+
+    if (m_tracer)
+        m_tracer->access(addr, value, true);
+
+    switch (m_pageType[page])
+    {
+        case PAGE_ROM :
+            break;
+
+        case PAGE_IO :
+            if (m_inputLog)
+                m_inputLog->write(*m_device[page], addr, value);
+            else
+                m_device[page]->write(addr, value);
+            break;
+
+        case PAGE_RAM :
+            if (m_code[addr]) {
+                m_code[addr] = 0;
+                if (--m_codeCount[page] == 0)
+                    updatePage(page);
+                m_observer->invalidate(addr);
+            }
+            m_data[addr] = value;
+            if (!m_dirty[page]) {
+                m_dirty[page] = 1;
+                updatePage(page);
+            }
+            break;
+    }
+
+    if ((m_watch[addr] & WATCH_WRITE) && m_observer)
+        m_observer->watchpoint(addr, true);
+} // writeSlow
+
+// Start tracking the pages written from now on.
+inline void Memory::track(uint64_t id)
+{
+    m_tracking = true;
+    m_baseline = id;
+
+    // Only the pages that were dirty change, e.g. after restoring the same
+    // snapshot again, which is done for every run when fuzzing.
+    for (unsigned page = 0; page < 256; ++page)
+    {
+        if (m_dirty[page]) {
+            m_dirty[page] = 0;
+            updatePage(page);
+        }
+    }
+} // track
+
+inline void Memory::save(uint8_t* image, uint64_t id)
+{
+    for (unsigned page = 0; page < 256; ++page)
+        std::copy(m_pageData[page], m_pageData[page] + 256, image + page*256);
+    track(id);
+} // save
+
+inline void Memory::restore(const uint8_t* image, uint64_t id)
+{
+    bool full = !m_tracking || id != m_baseline;
+    m_restored = 0;
+    for (unsigned page = 0; page < 256; ++page)
+    {
+        if (m_pageType[page] == PAGE_IO || mapped(page) || !(full || m_dirty[page]))
+            continue;
+
+        // Cached instructions that change have to be invalidated. ROM is
+        // not watched, but it can differ in an image from another machine.
+        unsigned base = page*256;
+        bool rom = (m_pageType[page] == PAGE_ROM);
+        if (m_codeCount[page] || (rom && m_observer)) {
+            for (unsigned addr = base; addr < base + 256; ++addr)
+            {
+                if (m_data[addr] == image[addr])
+                    continue;
+                if (m_code[addr]) {
+                    m_code[addr] = 0;
+                    m_codeCount[page] -= 1;
+                    m_observer->invalidate(addr);
+                } else if (rom)
+                    m_observer->invalidate(addr);
+            }
+        }
+        std::copy(image + base, image + base + 256, &m_data[base]);
+        m_restored += 1;
+    }
+
+    track(id);
+} // restore
+
+inline std::vector<uint8_t> Memory::update(uint8_t* image, uint64_t id)
+{
+    bool full = !m_tracking || id != m_baseline;
+    std::vector<uint8_t> pages;
+    for (unsigned page = 0; page < 256; ++page)
+    {
+        if (m_pageType[page] == PAGE_IO || !(full || m_dirty[page]))
+            continue;
+        std::copy(m_pageData[page], m_pageData[page] + 256, image + page*256);
+        pages.push_back(page);
+    }
 
+    track(id);
+    return pages;
+} // update
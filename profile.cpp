@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include "profile.h"
+#include "decode.h"
+#include "disas.h"
+
+// Names of the addressing modes, indexed by addrMode_t.
+static const char* const addrModeNames[] = {
+    "imm", "abs", "zp", "impl", "acc", "zp,X", "zp,Y", "abs,X", "abs,Y",
+    "(abs)", "(zp,X)", "(zp),Y", "rel", "res", "(zp)", "(abs,X)", "zp,rel"
+};
+
+Profiler::Profiler() : m_counts(65536, 0), m_pairs(65536, 0), m_previous(0), m_node(0), m_pending(PENDING_NONE), m_callSp(0)
+{
+    std::fill(m_mix, m_mix + 256, 0);
+    t_node root = {0, 0, 0, 0};
+    m_nodes.push_back(root);
+} // Profiler
+
+// Follow the call or return of the previous instruction, now that the
+// address it went to is known.
+void Profiler::update(uint16_t pc, uint8_t sp)
+{
+    if (m_pending == PENDING_CALL)
+    {
+        // Calls at the same stack depth or above mean that the program
+        // has left those routines without returning (e.g. reset the stack).
+        while (!m_stack.empty() && m_stack.back().sp <= m_callSp)
+            m_stack.pop_back();
+        uint32_t parent = m_stack.empty() ? 0 : m_stack.back().node;
+
+        uint64_t key = ((uint64_t) parent << 16) | pc;
+        auto it = m_children.find(key);
+        if (it == m_children.end()) {
+            t_node node = {pc, parent, 0, 0};
+            m_nodes.push_back(node);
+            it = m_children.emplace(key, (uint32_t) (m_nodes.size() - 1)).first;
+        }
+        m_nodes[it->second].calls += 1;
+
+        t_frame frame = {it->second, m_callSp};
+        m_stack.push_back(frame);
+    }
+    else
+    {
+        // Pop everything at or below the restored stack pointer.
+        while (!m_stack.empty() && m_stack.back().sp <= sp)
+            m_stack.pop_back();
+    }
+
+    m_node = m_stack.empty() ? 0 : m_stack.back().node;
+    m_pending = PENDING_NONE;
+} // update
+
+uint64_t Profiler::total() const
+{
+    uint64_t sum = 0;
+    for (uint64_t count : m_mix)
+        sum += count;
+    return sum;
+} // total
+
+// The instructions executed in each node and everything it called.
+std::vector<uint64_t> Profiler::inclusive() const
+{
+    std::vector<uint64_t> result(m_nodes.size());
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+        result[i] = m_nodes[i].self;
+
+    // Children are always created after their parent.
+    for (size_t i = m_nodes.size() - 1; i > 0; --i)
+        result[m_nodes[i].parent] += result[i];
+    return result;
+} // inclusive
+
+std::string Profiler::path(uint32_t node, const Symbols& symbols) const
+{
+    std::string result = (node == 0) ? "root" : symbols.name(m_nodes[node].routine);
+    while (node != 0)
+    {
+        node = m_nodes[node].parent;
+        result = ((node == 0) ? std::string("root") : symbols.name(m_nodes[node].routine)) + ";" + result;
+    }
+    return result;
+} // path
+
+void Profiler::report(std::ostream& os, const Memory& memory, const Symbols& symbols, unsigned top) const
+{
+    uint64_t sum = total();
+    if (sum == 0)
+        return;
+    auto percent = [sum](uint64_t count) {return 100.0 * count / sum;};
+    os << std::fixed << std::setprecision(2);
+    os << sum << " instructions profiled" << std::endl;
+
+    // Hot spots.
+    std::vector<uint16_t> addrs;
+    for (unsigned addr = 0; addr < 65536; ++addr)
+        if (m_counts[addr])
+            addrs.push_back(addr);
+    std::sort(addrs.begin(), addrs.end(),
+            [this](uint16_t a, uint16_t b) {return m_counts[a] > m_counts[b];});
+    if (addrs.size() > top)
+        addrs.resize(top);
+
+    os << std::endl << "      count      %  address" << std::endl;
+    for (uint16_t addr : addrs)
+    {
+        uint8_t bytes[3] = {memory.peek(addr), memory.peek(addr+1), memory.peek(addr+2)};
+        os << std::setw(11) << m_counts[addr] << std::setw(7) << percent(m_counts[addr]) << "  ";
+        os << std::hex << std::setw(4) << std::setfill('0') << addr << std::setfill(' ') << std::dec;
+        os << "  " << std::left << std::setw(20) << symbols.name(addr) << std::right << "  ";
+        disassemble(os, addr, bytes);
+        os << std::setfill(' ') << std::endl;
+    }
+
+    // Routines. A recursive routine is only counted at its outermost call.
+    std::vector<uint64_t> nodeTotals = inclusive();
+    typedef struct {uint64_t calls, self, total;} t_routine;
+    std::map<uint16_t, t_routine> routines;
+    for (uint32_t i = 1; i < m_nodes.size(); ++i)
+    {
+        const t_node& node = m_nodes[i];
+        t_routine& routine = routines[node.routine];
+        routine.calls += node.calls;
+        routine.self  += node.self;
+
+        bool recursive = false;
+        for (uint32_t p = node.parent; p != 0 && !recursive; p = m_nodes[p].parent)
+            recursive = (m_nodes[p].routine == node.routine);
+        if (!recursive)
+            routine.total += nodeTotals[i];
+    }
+    std::vector<std::pair<uint16_t, t_routine>> sorted(routines.begin(), routines.end());
+    std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<uint16_t, t_routine>& a, const std::pair<uint16_t, t_routine>& b) {
+                return a.second.total > b.second.total;
+            });
+    if (sorted.size() > top)
+        sorted.resize(top);
+
+    os << std::endl << "  inclusive      %  exclusive      %      calls  routine" << std::endl;
+    for (const auto& entry : sorted)
+    {
+        const t_routine& routine = entry.second;
+        os << std::setw(11) << routine.total << std::setw(7) << percent(routine.total);
+        os << std::setw(11) << routine.self  << std::setw(7) << percent(routine.self);
+        os << std::setw(11) << routine.calls << "  " << symbols.name(entry.first) << std::endl;
+    }
+
+    // Instruction mix, by opcode and by addressing mode.
+    std::vector<uint8_t> opcodes;
+    uint64_t modes[AM_ZR + 1] = {};
+    for (unsigned op = 0; op < 256; ++op)
+    {
+        if (m_mix[op])
+            opcodes.push_back(op);
+        modes[addrModes[op]] += m_mix[op];
+    }
+    std::sort(opcodes.begin(), opcodes.end(),
+            [this](uint8_t a, uint8_t b) {return m_mix[a] > m_mix[b];});
+
+    os << std::endl << "      count      %  instruction" << std::endl;
+    for (uint8_t op : opcodes)
+    {
+        os << std::setw(11) << m_mix[op] << std::setw(7) << percent(m_mix[op]) << "  ";
+        os << std::hex << std::setw(2) << std::setfill('0') << (unsigned) op << std::setfill(' ') << std::dec;
+        os << " " << mnemonic(op) << " " << addrModeNames[addrModes[op]] << std::endl;
+    }
+
+    os << std::endl << "      count      %  addressing mode" << std::endl;
+    for (unsigned mode = 0; mode <= AM_ZR; ++mode)
+        if (modes[mode])
+            os << std::setw(11) << modes[mode] << std::setw(7) << percent(modes[mode]) << "  " << addrModeNames[mode] << std::endl;
+
+    os << std::endl << "      count      %  pair (fusion candidates)" << std::endl;
+    for (uint16_t pair : hotPairs(top))
+    {
+        uint8_t first = pair >> 8, second = pair & 0xFF;
+        os << std::setw(11) << m_pairs[pair] << std::setw(7) << percent(m_pairs[pair]) << "  ";
+        os << std::hex << std::setfill('0') << std::setw(2) << (unsigned) first << " " << std::setw(2) << (unsigned) second;
+        os << std::setfill(' ') << std::dec << " " << mnemonic(first) << " " << addrModeNames[addrModes[first]];
+        os << ", " << mnemonic(second) << " " << addrModeNames[addrModes[second]] << std::endl;
+    }
+
+    os << std::defaultfloat;
+} // report
+
+void Profiler::folded(std::ostream& os, const Symbols& symbols) const
+{
+    for (uint32_t i = 0; i < m_nodes.size(); ++i)
+        if (m_nodes[i].self)
+            os << path(i, symbols) << " " << m_nodes[i].self << std::endl;
+} // folded
+
+// The pairs executed most often, with a first instruction that can be fused.
+std::vector<uint16_t> Profiler::hotPairs(unsigned top) const
+{
+    std::vector<uint16_t> pairs;
+    for (unsigned pair = 0; pair < 65536; ++pair)
+        if (m_pairs[pair] && fusable(instructions[pair >> 8]))
+            pairs.push_back(pair);
+    std::sort(pairs.begin(), pairs.end(),
+            [this](uint16_t a, uint16_t b) {return m_pairs[a] > m_pairs[b];});
+    if (pairs.size() > top)
+        pairs.resize(top);
+    return pairs;
+} // hotPairs
+
+void Profiler::fusion(std::ostream& os, unsigned top) const
+{
+    uint64_t sum = total();
+    os << "#pragma once" << std::endl << std::endl;
+    os << "#include <stdint.h>" << std::endl << std::endl;
+    os << "// The instruction pairs that the interpreter executes with one dispatch," << std::endl;
+    os << "// as the opcodes of the first and the second instruction. The first one" << std::endl;
+    os << "// must be fusable() (see decode.h)." << std::endl;
+    os << "//" << std::endl;
+    os << "// Regenerate with \"make fusion\", which profiles rom.bin and takes the" << std::endl;
+    os << "// pairs executed most often." << std::endl;
+    os << "static constexpr uint8_t fusedPairs[][2] = {" << std::endl;
+    std::vector<uint16_t> pairs = hotPairs(top);
+    // An empty array would be ill-formed, and BRK is never fused.
+    if (pairs.empty())
+        os << "    {0x00, 0x00},   // None profiled. BRK is not fusable(), so this never matches." << std::endl;
+    for (uint16_t pair : pairs)
+    {
+        uint8_t first = pair >> 8, second = pair & 0xFF;
+        os << std::hex << std::setfill('0') << "    {0x" << std::setw(2) << (unsigned) first;
+        os << ", 0x" << std::setw(2) << (unsigned) second << "},   // " << std::setfill(' ') << std::dec;
+        os << mnemonic(first) << " " << addrModeNames[addrModes[first]] << ", ";
+        os << mnemonic(second) << " " << addrModeNames[addrModes[second]];
+        os << std::fixed << std::setprecision(2) << "  " << (sum ? 100.0 * m_pairs[pair] / sum : 0) << "%" << std::defaultfloat << std::endl;
+    }
+    os << "};" << std::endl;
+} // fusion
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "memory.h"
+#include "symbols.h"
+
+// Where the guest program spends its time.
+//
+// Counts the instructions executed at each address, and for each opcode.
+// JSR, BRK, RTS, RTI and interrupts are followed on a shadow call stack,
+// which builds a call tree with the instructions executed in each node.
+// From that come the inclusive and exclusive counts per routine, and
+// folded stacks for flame graphs (e.g. flamegraph.pl).
+//
+// The CPU only calls the profiler when one is attached, from a separate
+// copy of the run loop, so it costs nothing otherwise.
+class Profiler
+{
+    public:
+        Profiler();
+
+        // Called by the CPU before each instruction.
+        void instruction(uint16_t pc, uint8_t opcode, uint8_t sp) {
+            if (m_pending)
+                update(pc, sp);
+            m_counts[pc] += 1;
+            m_mix[opcode] += 1;
+            m_pairs[(m_previous << 8) | opcode] += 1;
+            m_previous = opcode;
+            m_nodes[m_node].self += 1;
+            if (opcode == 0x20 || opcode == 0x00) {     // JSR, BRK
+                m_pending = PENDING_CALL;
+                m_callSp  = sp;
+            }
+            else if (opcode == 0x60 || opcode == 0x40)  // RTS, RTI
+                m_pending = PENDING_RETURN;
+        }
+
+        // Called by the CPU when it takes an interrupt, before anything is
+        // pushed. pc is the return address.
+        void interrupt(uint16_t pc, uint8_t sp) {
+            if (m_pending)
+                update(pc, sp);
+            m_pending = PENDING_CALL;
+            m_callSp  = sp;
+            m_previous = 0x00;  // BRK, which is never the first of a pair.
+        }
+
+        uint64_t count(uint16_t pc) const {return m_counts[pc];}
+        uint64_t total() const;
+
+        // A readable summary: the hottest addresses, the routines by
+        // inclusive count, and the instruction mix. The memory is used to
+        // disassemble the hot spots.
+        void report(std::ostream& os, const Memory& memory, const Symbols& symbols, unsigned top = 20) const;
+
+        // One line per call stack, e.g. "main;print;putc 1234".
+        void folded(std::ostream& os, const Symbols& symbols) const;
+
+        // The instruction pairs executed most often, of those that can be
+        // fused, written as a new fusion.h.
+        void fusion(std::ostream& os, unsigned top = 16) const;
+
+    private:
+        // A node of the call tree, i.e. a routine called along one path.
+        typedef struct {
+            uint16_t routine;       // The address called.
+            uint32_t parent;
+            uint64_t self;          // Instructions executed in this node.
+            uint64_t calls;
+        } t_node;
+
+        // A call on the shadow stack.
+        typedef struct {
+            uint32_t node;
+            uint8_t  sp;            // Before the call. Returning restores it.
+        } t_frame;
+
+        typedef enum {PENDING_NONE, PENDING_CALL, PENDING_RETURN} t_pending;
+
+        std::vector<uint64_t> m_counts;     // Indexed by address.
+        uint64_t m_mix[256];                // Indexed by opcode.
+        std::vector<uint64_t> m_pairs;      // Indexed by the previous and this opcode.
+        uint8_t   m_previous;
+
+        std::vector<t_node>  m_nodes;       // Node 0 is the root.
+        std::unordered_map<uint64_t, uint32_t> m_children;  // Parent and routine to node.
+        std::vector<t_frame> m_stack;
+        uint32_t  m_node;                   // The current node.
+        t_pending m_pending;                // Seen by the next instruction.
+        uint8_t   m_callSp;
+
+        void update(uint16_t pc, uint8_t sp);
+        std::vector<uint64_t> inclusive() const;
+        std::string path(uint32_t node, const Symbols& symbols) const;
+        std::vector<uint16_t> hotPairs(unsigned top) const;
+}; // end of class Profiler
+
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include "recorder.h"
+
+static const size_t NONE = ~(size_t) 0;
+
+Recorder::Recorder(Cpu65C02& cpu, Memory& memory, uint64_t interval) :
+    m_cpu(cpu), m_memory(memory), m_interval(interval ? interval : 1),
+    m_end(cpu.instructionCount()), m_replaying(false), m_read(0), m_interrupt(0),
+    m_image(65536, 0), m_imageId(Memory::newId()),
+    m_restored(65536, 0), m_restoredId(0), m_restoredCheckpoint(NONE)
+{
+    m_cpu.setRecorder(this);
+    m_memory.setInputLog(this);
+    checkpoint();
+} // Recorder
+
+Recorder::~Recorder()
+{
+    m_cpu.setRecorder(0);
+    m_memory.setInputLog(0);
+} // ~Recorder
+
+uint8_t Recorder::read(Device& device, uint16_t addr)
+{
+    if (m_replaying)
+        return (m_read < m_reads.size()) ? m_reads[m_read++] : 0xFF;
+
+    uint8_t value = device.read(addr);
+    m_reads.push_back(value);
+    return value;
+} // read
+
+// The devices are left alone while replaying.
+void Recorder::write(Device& device, uint16_t addr, uint8_t value)
+{
+    if (!m_replaying)
+        device.write(addr, value);
+} // write
+
+void Recorder::interrupt(uint32_t irqLines, bool nmi)
+{
+    t_interrupt entry = {m_cpu.instructionCount(), m_cpu.cycleCount(), irqLines, nmi};
+    m_interrupts.push_back(entry);
+} // interrupt
+
+// Only the memory pages written since the previous checkpoint are stored.
+void Recorder::checkpoint()
+{
+    t_checkpoint checkpoint;
+    checkpoint.state     = m_cpu.getState();
+    checkpoint.read      = m_reads.size();
+    checkpoint.interrupt = m_interrupts.size();
+    checkpoint.pages     = m_memory.update(m_image.data(), m_imageId);
+    for (uint8_t page : checkpoint.pages)
+        checkpoint.data.insert(checkpoint.data.end(), &m_image[page*256], &m_image[page*256] + 256);
+    m_checkpoints.push_back(std::move(checkpoint));
+} // checkpoint
+
+// Put the memory together from the pages of all checkpoints up to this one,
+// or only the newer ones if an older checkpoint has been loaded last.
+void Recorder::load(size_t index)
+{
+    if (m_restoredCheckpoint != index)
+    {
+        size_t first = (m_restoredCheckpoint < index) ? m_restoredCheckpoint + 1 : 0;
+        for (size_t i = first; i <= index; ++i)
+        {
+            const t_checkpoint& checkpoint = m_checkpoints[i];
+            for (size_t n = 0; n < checkpoint.pages.size(); ++n)
+                std::copy(&checkpoint.data[n*256], &checkpoint.data[n*256] + 256, &m_restored[checkpoint.pages[n]*256]);
+        }
+        m_restoredId = Memory::newId();
+        m_restoredCheckpoint = index;
+    }
+
+    // Restoring the same checkpoint again only copies the pages written since.
+    const t_checkpoint& checkpoint = m_checkpoints[index];
+    m_memory.restore(m_restored.data(), m_restoredId);
+    m_cpu.setState(checkpoint.state);
+    m_read      = checkpoint.read;
+    m_interrupt = checkpoint.interrupt;
+    m_replaying = true;
+} // load
+
+// The last checkpoint at or before the instruction count.
+size_t Recorder::checkpointBefore(uint64_t instruction) const
+{
+    auto it = std::upper_bound(m_checkpoints.begin(), m_checkpoints.end(), instruction,
+            [](uint64_t n, const t_checkpoint& checkpoint) {return n < checkpoint.state.instructions;});
+    return (it == m_checkpoints.begin()) ? 0 : (it - m_checkpoints.begin()) - 1;
+} // checkpointBefore
+
+// Run up to the instruction count limit with the logged inputs. The CPU is
+// stopped at each logged interrupt change, which is applied before the next
+// instruction, just like the scheduler did when it was recorded.
+Cpu65C02::t_stopReason Recorder::replay(uint64_t limit, uint32_t stopMask)
+{
+    bool resumed = true;
+    while (true)
+    {
+        uint64_t count = m_cpu.instructionCount();
+        bool changed = false;
+        while (m_interrupt < m_interrupts.size() && m_interrupts[m_interrupt].instruction <= count)
+        {
+            const t_interrupt& entry = m_interrupts[m_interrupt++];
+            Cpu65C02::t_state state = m_cpu.getState();
+            state.irqLines = entry.irqLines;
+            state.nmi     |= entry.nmi;
+            if (state.waiting)
+                state.cycles = entry.cycle;     // The time spent waiting.
+            m_cpu.setState(state);
+            changed = true;
+        }
+        if (count >= limit)
+            return Cpu65C02::STOP_BUDGET;
+
+        // Only the logged inputs can wake up the CPU.
+        Cpu65C02::t_state state = m_cpu.getState();
+        if (state.waiting && !state.irqLines && !state.nmi)
+            return Cpu65C02::STOP_WAIT;
+
+        // The CPU ignores a breakpoint where it starts, which is only right
+        // where the caller resumes. Nor does it stop there if an interrupt
+        // is taken first.
+        bool interrupt = state.nmi || (state.irqLines && !(state.registers.flags & Cpu65C02::FLAG_I));
+        if (!resumed && (stopMask & Cpu65C02::STOP_BREAKPOINT) && !(changed && interrupt) &&
+                m_cpu.atBreakpoint())
+            return Cpu65C02::STOP_BREAKPOINT;
+        resumed = false;
+
+        uint64_t next = limit;
+        if (m_interrupt < m_interrupts.size() && m_interrupts[m_interrupt].instruction < next)
+            next = m_interrupts[m_interrupt].instruction;
+
+        Cpu65C02::t_stopReason reason = m_cpu.run(next - count, stopMask);
+        if (reason != Cpu65C02::STOP_BUDGET)
+            return reason;
+    }
+} // replay
+
+Cpu65C02::t_stopReason Recorder::run(uint64_t budget, uint32_t stopMask)
+{
+    uint64_t count  = m_cpu.instructionCount();
+    uint64_t target = (budget > ~0ULL - count) ? ~0ULL : count + budget;
+
+    if (m_replaying)
+    {
+        // At the end of the recording, the devices take over again.
+        Cpu65C02::t_stopReason reason = replay(std::min(target, m_end), stopMask);
+        m_replaying = (m_cpu.instructionCount() < m_end);
+        if (reason != Cpu65C02::STOP_BUDGET || m_cpu.instructionCount() == target)
+            return reason;
+    }
+
+    while (true)
+    {
+        count = m_cpu.instructionCount();
+        if (count >= target)
+            return Cpu65C02::STOP_BUDGET;
+
+        uint64_t next = m_checkpoints.back().state.instructions + m_interval;
+        Cpu65C02::t_stopReason reason = m_cpu.run(std::min(target, next) - count, stopMask);
+        m_end       = m_cpu.instructionCount();
+        m_read      = m_reads.size();
+        m_interrupt = m_interrupts.size();
+        if (m_end >= next)
+            checkpoint();
+        if (reason != Cpu65C02::STOP_BUDGET)
+            return reason;
+    }
+} // run
+
+bool Recorder::seek(uint64_t instruction)
+{
+    if (instruction < begin() || instruction > m_end)
+        return false;
+
+    // Run forward from where we are, if that is no further than from the
+    // last checkpoint before the destination.
+    uint64_t count = m_cpu.instructionCount();
+    size_t index = checkpointBefore(instruction);
+    if (count > instruction || count < m_checkpoints[index].state.instructions)
+        load(index);
+    else if (count == m_end)
+        return true;
+
+    m_replaying = true;
+    replay(instruction, 0);
+    m_replaying = (m_cpu.instructionCount() < m_end);
+    return m_cpu.instructionCount() == instruction;
+} // seek
+
+bool Recorder::stepBack()
+{
+    uint64_t count = m_cpu.instructionCount();
+    return count > begin() && seek(count - 1);
+} // stepBack
+
+// Each stretch between two checkpoints is replayed, from the most recent
+// one backwards, until it has a stop. It is then replayed once more, up to
+// the last stop in it.
+Cpu65C02::t_stopReason Recorder::reverseContinue(uint32_t stopMask)
+{
+    uint64_t upper = m_cpu.instructionCount();     // Only stops before this.
+    if (upper <= begin())
+        return Cpu65C02::STOP_BUDGET;
+
+    size_t index = checkpointBefore(upper - 1);
+    while (true)
+    {
+        load(index);
+        unsigned stops = 0;
+        Cpu65C02::t_stopReason reason;
+        while ((reason = replay(upper, stopMask)) & stopMask)
+        {
+            if (m_cpu.instructionCount() >= upper)
+                break;
+            stops += 1;
+            if (reason == Cpu65C02::STOP_WAIT)
+                break;
+        }
+
+        if (stops > 0) {
+            load(index);
+            for (unsigned i = 0; i < stops; ++i)
+                reason = replay(upper, stopMask);
+            m_replaying = (m_cpu.instructionCount() < m_end);
+            return reason;
+        }
+        if (index == 0) {
+            seek(begin());
+            return Cpu65C02::STOP_BUDGET;
+        }
+
+        // Stops at the checkpoint itself are only seen from the one before.
+        upper = m_checkpoints[index].state.instructions + 1;
+        index -= 1;
+    }
+} // reverseContinue
+
+size_t Recorder::bytes() const
+{
+    size_t total = m_reads.size() + m_interrupts.size() * sizeof(t_interrupt) + m_image.size() + m_restored.size();
+    for (const t_checkpoint& checkpoint : m_checkpoints)
+        total += sizeof(checkpoint) + checkpoint.pages.size() + checkpoint.data.size();
+    return total;
+} // bytes
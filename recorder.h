@@ -0,0 +1,93 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "cpu65c02.h"
+
+// Deterministic record and replay, for going back in time.
+//
+// Only what the program can not compute itself is logged: the values read
+// from devices, and the changes of the interrupt inputs with the
+// instruction count at which they happened. Every interval instructions a
+// checkpoint is taken, holding the CPU state and the memory pages written
+// since the previous one.
+//
+// To go to an earlier instruction, the nearest checkpoint before it is
+// restored, and the program runs forward from there with the logged inputs
+// instead of the devices. Going forward again up to the end of the
+// recording is also a replay, after which the devices take over again.
+//
+// The program must be run with Recorder::run() instead of the CPU. Idle
+// loops are not skipped while recording, since the skipping depends on the
+// devices.
+class Recorder : public InputLog
+{
+    public:
+        Recorder(Cpu65C02& cpu, Memory& memory, uint64_t interval = 1000000);
+        virtual ~Recorder();
+
+        // Like Cpu65C02::run(). Replays first when not at the end.
+        Cpu65C02::t_stopReason run(uint64_t budget, uint32_t stopMask = Cpu65C02::STOP_ALL);
+
+        // Go to the state after the given instruction count, which must be
+        // between begin() and end().
+        bool seek(uint64_t instruction);
+
+        // Go back one instruction. Returns false at the beginning.
+        bool stepBack();
+
+        // Go back to the last stop for one of the reasons in stopMask, e.g.
+        // a breakpoint, and return that reason. Returns STOP_BUDGET when
+        // there is none and the beginning has been reached.
+        Cpu65C02::t_stopReason reverseContinue(uint32_t stopMask);
+
+        uint64_t begin() const {return m_checkpoints.front().state.instructions;}
+        uint64_t end() const   {return m_end;}
+        bool replaying() const {return m_replaying;}
+        size_t bytes() const;   // Memory used by the recording.
+
+        // Called by the memory and the CPU.
+        virtual uint8_t read(Device& device, uint16_t addr);
+        virtual void write(Device& device, uint16_t addr, uint8_t value);
+        void interrupt(uint32_t irqLines, bool nmi);
+
+    private:
+        typedef struct {
+            uint64_t instruction;   // Taken before the next instruction.
+            uint64_t cycle;
+            uint32_t irqLines;
+            bool     nmi;
+        } t_interrupt;
+
+        typedef struct {
+            Cpu65C02::t_state state;
+            size_t   read;          // Positions in the logs.
+            size_t   interrupt;
+            std::vector<uint8_t> pages;     // Written since the previous checkpoint.
+            std::vector<uint8_t> data;      // 256 bytes for each page.
+        } t_checkpoint;
+
+        Cpu65C02& m_cpu;
+        Memory&   m_memory;
+        uint64_t  m_interval;
+        uint64_t  m_end;            // Instruction count at the end of the recording.
+        bool      m_replaying;
+
+        std::vector<uint8_t>     m_reads;
+        std::vector<t_interrupt> m_interrupts;
+        std::vector<t_checkpoint> m_checkpoints;
+        size_t    m_read;           // Next to replay.
+        size_t    m_interrupt;
+
+        // The memory at the last checkpoint, and at a restored one.
+        std::vector<uint8_t> m_image;
+        uint64_t  m_imageId;
+        std::vector<uint8_t> m_restored;
+        uint64_t  m_restoredId;
+        size_t    m_restoredCheckpoint;
+
+        void checkpoint();
+        void load(size_t checkpoint);
+        size_t checkpointBefore(uint64_t instruction) const;
+        Cpu65C02::t_stopReason replay(uint64_t limit, uint32_t stopMask);
+}; // end of class Recorder
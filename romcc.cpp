@@ -0,0 +1,167 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include "cpu65c02.h"
+#include "decode.h"
+#include "disas.h"
+#include "image.h"
+
+// Compile a ROM image ahead of time into C++ for the CpuAot engine (aot.h).
+//
+// The code is found by following the control flow from the vectors, and
+// from any extra entry points given in hex. It is split into basic blocks,
+// which start at every entry point, jump or branch target, and after every
+// instruction that ends a block. Each block becomes a function executing
+// its instructions one after the other.
+
+static const uint16_t maxInstructions = 64;    // Per block.
+
+// Decoded instructions are written as initializers of Cpu65C02::t_decoded.
+static void writeDecoded(std::ostream& os, uint16_t pc, const uint8_t bytes[3])
+{
+    Cpu65C02::t_decoded d;
+    Cpu65C02::decodeBytes(d, pc, bytes);
+
+    char text[DISASSEMBLY_SIZE];
+    disassemble(text, pc, bytes);
+
+    char line[128];
+    snprintf(line, sizeof(line), "        {0, 0x%02x, %2u, %2u, %u, 0x%04x, 0x%02x, %u},   // %04x  %s\n",
+            d.opcode, d.addrMode, d.instruction, d.length, d.operand, d.zp, d.bit, pc, text);
+    os << line;
+} // writeDecoded
+
+// The addresses of the instructions in the block starting at pc.
+static std::vector<uint16_t> block(const std::vector<uint8_t>& image, const std::vector<uint8_t>& code,
+        const std::vector<uint8_t>& leaders, uint16_t pc)
+{
+    std::vector<uint16_t> addresses;
+    unsigned addr = pc;
+    do {
+        addresses.push_back(addr);
+        uint8_t opcode = image[addr];
+        addr += instructionLength(opcode);
+        if (endsBlock(instructions[opcode]))
+            break;
+    } while (addr < 0x10000 && code[addr] && !leaders[addr] && addresses.size() < maxInstructions);
+    return addresses;
+} // block
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: romcc rom.bin [entry points in hex] > romaot.cpp" << std::endl;
+        return 1;
+    }
+
+    // Placed the same way as when it is run.
+    RomImage rom;
+    if (!rom.loadBinary(argv[1]))
+    {
+        std::cerr << "Could not read a ROM image from " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> image = rom.contents();
+
+    std::vector<uint16_t> entries = entryPoints(image.data());
+    for (int i = 2; i < argc; ++i)
+        entries.push_back(strtoul(argv[i], 0, 16));
+    std::vector<uint8_t> code = findCode(image.data(), entries);
+
+    std::vector<uint8_t> leaders(65536, 0);
+    for (uint16_t entry : entries)
+        leaders[entry] = 1;
+    for (unsigned pc = 0; pc < 0x10000; ++pc)
+    {
+        if (!code[pc])
+            continue;
+        uint8_t bytes[3] = {image[pc], image[(pc+1) & 0xFFFF], image[(pc+2) & 0xFFFF]};
+        Cpu65C02::t_decoded d;
+        Cpu65C02::decodeBytes(d, pc, bytes);
+
+        if (d.addrMode == AM_REL || d.addrMode == AM_ZR ||
+            (d.addrMode == AM_ABS && (d.instruction == I_JMP || d.instruction == I_JSR)))
+            leaders[d.operand] = 1;
+        if (endsBlock((instruction_t) d.instruction))
+            leaders[(pc + d.length) & 0xFFFF] = 1;
+    }
+
+    std::cout << "// Generated by romcc from " << argv[1] << ". Do not edit.\n";
+    std::cout << "#include \"aot.h\"\n";
+    std::cout << "#include \"execute.h\"\n";
+
+    // The blocks, as functions named after their address. The decoded
+    // instructions are constants, so the compiler resolves the operands.
+    std::vector<uint16_t> blocks;
+    char line[256];
+    for (unsigned pc = 0; pc < 0x10000; ++pc)
+    {
+        if (!code[pc] || !leaders[pc])
+            continue;
+        blocks.push_back(pc);
+
+        std::vector<uint16_t> addresses = block(image, code, leaders, pc);
+        std::cout << "\nstatic uint32_t block_" << std::hex << pc << std::dec << "(CpuAot& aot, Cpu65C02& cpu)\n{\n";
+        std::cout << "    static constexpr Cpu65C02::t_decoded d[] = {\n";
+        for (uint16_t a : addresses)
+        {
+            uint8_t bytes[3] = {image[a], image[(uint16_t) (a+1)], image[(uint16_t) (a+2)]};
+            writeDecoded(std::cout, a, bytes);
+        }
+        std::cout << "    };\n";
+
+        bool checked = false;
+        for (size_t i = 0; i < addresses.size(); ++i)
+        {
+            uint8_t opcode = image[addresses[i]];
+            snprintf(line, sizeof(line), "    CpuAot::execute<0x%02x, 0x%04x>(cpu, d[%zu]);\n", opcode, addresses[i], i);
+            std::cout << line;
+
+            // Writes may change the code of this block, or make a device
+            // raise an interrupt, and CLI and PLP may allow one.
+            instruction_t inst = instructions[opcode];
+            if (i + 1 < addresses.size() && (writesMemory(inst) || inst == I_CLI || inst == I_PLP)) {
+                std::cout << "    if (aot.aborted() || CpuAot::eventDue(cpu))\n        return " << i + 1 << ";\n";
+                checked = true;
+            }
+        }
+        if (!checked)
+            std::cout << "    (void) aot;\n";
+        std::cout << "    return " << addresses.size() << ";\n";
+        std::cout << "} // block_" << std::hex << pc << std::dec << "\n";
+    }
+
+    // The table of blocks. Each instruction takes at most three cycles more
+    // than in the cycle table: one for crossing a page, or two for a branch
+    // taken to another page, and one in decimal mode.
+    std::cout << "\nconst CpuAot::t_block aotBlocks[] = {\n";
+    for (uint16_t pc : blocks)
+    {
+        std::vector<uint16_t> addresses = block(image, code, leaders, pc);
+        unsigned lastPc = addresses.back();
+        unsigned size = lastPc + instructionLength(image[lastPc]) - pc;
+        unsigned maxCycles = 0;
+        for (uint16_t addr : addresses)
+            maxCycles += cycles[image[addr]] + 3;
+
+        snprintf(line, sizeof(line), "    {0x%04x, 0x%04x, %u, %zu, %u, block_%x},\n",
+                pc, lastPc, size, addresses.size(), maxCycles, pc);
+        std::cout << line;
+    }
+    if (blocks.empty())
+        std::cout << "    {0, 0, 0, 0, 0, 0}\n";
+    std::cout << "};\n";
+    std::cout << "const size_t aotBlockCount = " << blocks.size() << ";\n";
+
+    std::cout << "\nconst uint8_t aotImage[65536] = {";
+    for (unsigned addr = 0; addr < 0x10000; ++addr)
+    {
+        snprintf(line, sizeof(line), "%s%u,", (addr % 32) ? "" : "\n    ", image[addr]);
+        std::cout << line;
+    }
+    std::cout << "\n};\n";
+
+    std::cerr << blocks.size() << " blocks compiled" << std::endl;
+    return std::cout.good() ? 0 : 1;
+} // main
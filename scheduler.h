@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+
+// Interface for anyone who wants to be called at a given clock cycle,
+// e.g. a timer or a serial port.
+class EventHandler
+{
+    public:
+        virtual ~EventHandler() {}
+
+        // Called when the CPU has reached the cycle of an event posted to
+        // the Scheduler. The handler may post new events.
+        virtual void event(uint64_t cycle) = 0;
+}; // end of class EventHandler
+
+// Future events, ordered by the clock cycle they are due.
+//
+// The CPU only compares its cycle counter with next() after each
+// instruction, so that nothing is polled while no event is due. Events due
+// at the same cycle are handled in the order they were posted.
+class Scheduler
+{
+    public:
+        static const uint64_t NEVER = ~0ULL;
+
+        Scheduler() : m_next(NEVER), m_sequence(0) {}
+
+        void post(uint64_t cycle, EventHandler* handler);
+
+        // Remove all events posted by this handler.
+        void cancel(EventHandler* handler);
+
+        // The cycle of the first event, or NEVER.
+        uint64_t next() const {return m_next;}
+
+        // Call the handlers of all events due at or before the given cycle.
+        void dispatch(uint64_t cycle);
+
+    private:
+        typedef struct {
+            uint64_t      cycle;
+            uint64_t      sequence;     // Order of posting.
+            EventHandler* handler;
+        } t_event;
+
+        std::vector<t_event> m_heap;    // The first event is at the front.
+        uint64_t m_next;
+        uint64_t m_sequence;
+
+        // Ordering for the heap, which keeps the largest element first.
+        static bool later(const t_event& a, const t_event& b) {
+            return (a.cycle != b.cycle) ? a.cycle > b.cycle : a.sequence > b.sequence;
+        }
+        void update() {m_next = m_heap.empty() ? NEVER : m_heap.front().cycle;}
+}; // end of class Scheduler
+
+inline void Scheduler::post(uint64_t cycle, EventHandler* handler)
+{
+    t_event event = {cycle, m_sequence++, handler};
+    m_heap.push_back(event);
+    std::push_heap(m_heap.begin(), m_heap.end(), later);
+    update();
+} // post
+
+inline void Scheduler::cancel(EventHandler* handler)
+{
+    m_heap.erase(std::remove_if(m_heap.begin(), m_heap.end(),
+                [handler](const t_event& event) {return event.handler == handler;}),
+            m_heap.end());
+    std::make_heap(m_heap.begin(), m_heap.end(), later);
+    update();
+} // cancel
+
+inline void Scheduler::dispatch(uint64_t cycle)
+{
+    while (!m_heap.empty() && m_heap.front().cycle <= cycle)
+    {
+        t_event event = m_heap.front();
+        std::pop_heap(m_heap.begin(), m_heap.end(), later);
+        m_heap.pop_back();
+        update();
+
+        event.handler->event(event.cycle);
+    }
+} // dispatch
+
@@ -0,0 +1,58 @@
+#include <cstring>
+#include <fstream>
+#include "snapshot.h"
+
+// The file starts with this header, followed by the CPU state and the
+// 64 KB of memory. Everything is stored in host byte order.
+typedef struct {
+    char     magic[4];      // "S65C"
+    uint32_t stateSize;
+} t_header;
+
+void Snapshot::save(const Cpu65C02& cpu, Memory& memory)
+{
+    m_state = cpu.getState();
+    m_id = Memory::newId();
+    memory.save(m_memory.data(), m_id);
+} // save
+
+void Snapshot::restore(Cpu65C02& cpu, Memory& memory) const
+{
+    memory.restore(m_memory.data(), m_id);
+    cpu.setState(m_state);
+} // restore
+
+bool Snapshot::write(const std::string& fileName) const
+{
+    std::ofstream file(fileName, std::ios::out | std::ios::binary);
+
+    t_header header;
+    memcpy(header.magic, "S65C", 4);
+    header.stateSize = sizeof(m_state);
+    file.write((const char*) &header, sizeof(header));
+    file.write((const char*) &m_state, sizeof(m_state));
+    file.write((const char*) m_memory.data(), m_memory.size());
+    return file.good();
+} // write
+
+bool Snapshot::read(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ios::in | std::ios::binary);
+
+    t_header header;
+    file.read((char*) &header, sizeof(header));
+    if (!file || memcmp(header.magic, "S65C", 4) || header.stateSize != sizeof(m_state))
+        return false;
+
+    Cpu65C02::t_state state;
+    std::vector<uint8_t> memory(65536);
+    file.read((char*) &state, sizeof(state));
+    file.read((char*) memory.data(), memory.size());
+    if (!file)
+        return false;
+
+    m_state = state;
+    m_memory.swap(memory);
+    m_id = Memory::newId();
+    return true;
+} // read
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "cpu65c02.h"
+
+// The complete state of the CPU and its memory, to go back to later, e.g.
+// to run many tests from the state after the setup code instead of from
+// reset.
+//
+// Memory is copy-on-write at page granularity: after save() or restore(),
+// the memory tracks which pages are written, so that restoring the same
+// snapshot again only copies those pages back. Restoring any other
+// snapshot copies all of memory.
+//
+// Devices, the page mapping and scheduled events are not part of the
+// snapshot. Devices that have state must save and restore it themselves.
+class Snapshot
+{
+    public:
+        Snapshot() : m_memory(65536, 0), m_id(0) {
+            m_state = Cpu65C02::t_state();
+        }
+
+        void save(const Cpu65C02& cpu, Memory& memory);
+        void restore(Cpu65C02& cpu, Memory& memory) const;
+
+        // A file holds one snapshot, so it can be taken in one process and
+        // restored in others.
+        bool write(const std::string& fileName) const;
+        bool read(const std::string& fileName);
+
+        const Cpu65C02::t_state& state() const {return m_state;}
+        uint8_t peek(uint16_t addr) const {return m_memory[addr];}
+
+    private:
+        Cpu65C02::t_state    m_state;
+        std::vector<uint8_t> m_memory;
+        uint64_t m_id;      // Changes whenever the memory contents do.
+}; // end of class Snapshot
@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include "symbols.h"
+
+static bool parseHex(const std::string& text, uint16_t& value)
+{
+    char* end = 0;
+    unsigned long result = strtoul(text.c_str(), &end, 16);
+    if (text.empty() || *end != 0 || result > 0xFFFFFF)
+        return false;
+    value = (uint16_t) result;
+    return true;
+} // parseHex
+
+// Both formats are recognized line by line. A VICE label file has lines
+// like "al 00C000 .start". In a map file, each line of the export lists
+// has up to two entries of name, value and flags, e.g.
+// "main    00C000 RLA    nmi     00C123 RLA".
+//
+// Linker-generated symbols like __RAM_START__ are skipped. When several
+// symbols have the same address, the first one is kept.
+bool Symbols::load(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    if (!file)
+        return false;
+
+    bool exports = false;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream words(line);
+        std::string name, value, flags;
+        uint16_t addr;
+
+        if (line.compare(0, 3, "al ") == 0) {
+            words >> flags >> value >> name;
+            if (!name.empty() && name[0] == '.')
+                name.erase(0, 1);
+            if (!name.empty() && parseHex(value, addr))
+                m_names.emplace(addr, name);
+            continue;
+        }
+
+        // Section headers end with a colon.
+        if (!line.empty() && line.back() == ':') {
+            exports = (line.compare(0, 12, "Exports list") == 0);
+            continue;
+        }
+        if (!exports || line.empty() || line[0] == '-')
+            continue;
+
+        while (words >> name >> value >> flags)
+        {
+            if (name.compare(0, 2, "__") != 0 && parseHex(value, addr))
+                m_names.emplace(addr, name);
+        }
+    }
+
+    return true;
+} // load
+
+std::string Symbols::exact(uint16_t addr) const
+{
+    auto it = m_names.find(addr);
+    return (it != m_names.end()) ? it->second : std::string();
+} // exact
+
+std::string Symbols::name(uint16_t addr) const
+{
+    std::ostringstream os;
+    auto it = m_names.upper_bound(addr);
+    if (it == m_names.begin()) {
+        os << "$" << std::hex;
+        os.width(4);
+        os.fill('0');
+        os << addr;
+        return os.str();
+    }
+
+    --it;
+    os << it->second;
+    if (it->first != addr)
+        os << "+" << addr - it->first;
+    return os.str();
+} // name
+
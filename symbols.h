@@ -0,0 +1,29 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <stdint.h>
+
+// Names of addresses in the guest program, read from the files written by
+// the ld65 linker: the map file (ld65 -m), whose export lists are used, and
+// the VICE label file (ld65 -Ln), which also has the local labels.
+class Symbols
+{
+    public:
+        // Add the symbols from a file. Returns false if it can not be read.
+        bool load(const std::string& fileName);
+
+        void add(uint16_t addr, const std::string& name) {m_names[addr] = name;}
+        bool empty() const {return m_names.empty();}
+
+        // The name of the address itself, or an empty string.
+        std::string exact(uint16_t addr) const;
+
+        // The nearest symbol at or below the address, e.g. "print+3".
+        // Addresses without a symbol below them are written as "$c000".
+        std::string name(uint16_t addr) const;
+
+    private:
+        std::map<uint16_t, std::string> m_names;
+}; // end of class Symbols
+
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cpu65c02.h"
+
+// A programmable interval timer raising IRQ, as an example of a device
+// driven by the scheduler. Map it with e.g. mem.mapDevice(0xD0, 0xD0, &timer).
+//
+// Registers:
+//   +0, +1 : Period in clock cycles, low and high byte.
+//   +2     : Control. Bit 0 starts the timer, bit 1 enables the IRQ.
+//   +3     : Status. Bit 7 is set each time the period has passed.
+//            Reading clears it, and the IRQ.
+class Timer : public Device, public EventHandler
+{
+    public:
+        Timer(Cpu65C02& cpu, uint32_t irqSource = 1) : m_cpu(cpu), m_irqSource(irqSource),
+            m_period(0), m_control(0), m_status(0) {}
+
+        virtual uint8_t read(uint16_t addr);
+        virtual void write(uint16_t addr, uint8_t value);
+        virtual void event(uint64_t cycle);
+
+        // Only the status changes when read, as reading clears it.
+        virtual bool stableRead(uint16_t addr) const {return (addr & 3) != 3;}
+
+    private:
+        Cpu65C02& m_cpu;
+        uint32_t  m_irqSource;
+        uint16_t  m_period;
+        uint8_t   m_control;
+        uint8_t   m_status;
+}; // end of class Timer
+
+inline uint8_t Timer::read(uint16_t addr)
+{
+    switch (addr & 3)
+    {
+        case 0 : return m_period & 0xFF;
+        case 1 : return m_period >> 8;
+        case 2 : return m_control;
+    }
+
+    uint8_t status = m_status;
+    m_status = 0;
+    m_cpu.irq(m_irqSource, false);
+    return status;
+} // read
+
+inline void Timer::write(uint16_t addr, uint8_t value)
+{
+    switch (addr & 3)
+    {
+        case 0 : m_period = (m_period & 0xFF00) | value; break;
+        case 1 : m_period = (m_period & 0x00FF) | (value << 8); break;
+        case 2 :
+            // (Re)start counting from now.
+            m_cpu.scheduler().cancel(this);
+            m_control = value;
+            if ((m_control & 1) && m_period)
+                m_cpu.scheduler().post(m_cpu.cycleCount() + m_period, this);
+            break;
+        case 3 : break;
+    }
+} // write
+
+inline void Timer::event(uint64_t cycle)
+{
+    m_status |= 0x80;
+    if (m_control & 2)
+        m_cpu.irq(m_irqSource, true);
+    // A period of zero stops the timer, rather than firing on every cycle.
+    if (m_period)
+        m_cpu.scheduler().post(cycle + m_period, this);
+} // event
+
@@ -0,0 +1,121 @@
+#include <cstring>
+#include <fstream>
+#include "trace.h"
+#include "disas.h"
+
+// The file starts with this header, followed by the records.
+// Everything is stored in host byte order.
+typedef struct {
+    char     magic[4];      // "T65C"
+    uint32_t recordSize;
+    uint64_t first;         // Instruction number of the first record.
+    uint64_t count;         // Number of records in the file.
+} t_header;
+
+Trace::Trace(size_t size) : m_count(0), m_current(&m_scratch), m_sink(0)
+{
+    size_t actual = 1;
+    while (actual < size)
+        actual *= 2;
+    m_records.resize(actual);
+    m_mask = actual-1;
+    m_scratch.accesses = 0;
+} // Trace
+
+void Trace::blockDone()
+{
+    m_sink->blockDone(m_count / blockRecords - 1);
+} // blockDone
+
+bool Trace::save(const std::string& fileName) const
+{
+    std::ofstream file(fileName, std::ios::out | std::ios::binary);
+
+    uint64_t count = (m_count < m_records.size()) ? m_count : m_records.size();
+    t_header header;
+    memcpy(header.magic, "T65C", 4);
+    header.recordSize = sizeof(t_record);
+    header.first      = m_count - count;
+    header.count      = count;
+    file.write((const char*) &header, sizeof(header));
+
+    for (uint64_t i = header.first; i < m_count; ++i)
+        file.write((const char*) &m_records[i & m_mask], sizeof(t_record));
+
+    return file.good();
+} // save
+
+bool Trace::load(const std::string& fileName, std::vector<t_record>& records, uint64_t& first)
+{
+    std::ifstream file(fileName, std::ios::in | std::ios::binary);
+
+    t_header header;
+    file.read((char*) &header, sizeof(header));
+    if (!file || memcmp(header.magic, "T65C", 4) || header.recordSize != sizeof(t_record))
+        return false;
+
+    records.resize(header.count);
+    file.read((char*) records.data(), header.count * sizeof(t_record));
+    first = header.first;
+    return file.good();
+} // load
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static char* hex2(char* out, uint8_t value)
+{
+    out[0] = hexDigits[value >> 4];
+    out[1] = hexDigits[value & 0xF];
+    return out + 2;
+}
+
+static char* append(char* out, const char* text, size_t length)
+{
+    memcpy(out, text, length);
+    return out + length;
+}
+
+size_t Trace::formatState(char* buf, const t_record& record)
+{
+    static const char flagNames[] = "SVRBDIZC";
+
+    char* out = append(buf, "PC: ", 4);
+    out = hex2(hex2(out, record.pc >> 8), record.pc & 0xFF);
+    out = hex2(append(out, "  AREG : ", 9), record.areg);
+    out = hex2(append(out, "  XREG : ", 9), record.xreg);
+    out = hex2(append(out, "  YREG : ", 9), record.yreg);
+    out = hex2(append(out, "  SP : ", 7), record.sp);
+    out = append(out, "  FLAGS : ", 10);
+    for (int i = 0; i < 8; ++i)
+        *out++ = (record.flags & (0x80 >> i)) ? flagNames[i] : '.';
+
+    out = append(out, "   ", 3);
+    out += disassemble(out, record.pc, record.bytes);
+    return out - buf;
+} // formatState
+
+size_t Trace::formatAccesses(char* buf, const t_record& record)
+{
+    char* out = buf;
+    for (uint8_t i = 0; i < record.accesses && i < maxAccesses; ++i)
+    {
+        bool write = record.writes & (1 << i);
+        out = hex2(append(out, write ? "Writing value " : "Reading value ", 14), record.value[i]);
+        out = write ? append(out, " to address ", 12) : append(out, " from address ", 14);
+        out = hex2(hex2(out, record.addr[i] >> 8), record.addr[i] & 0xFF);
+        *out++ = '\n';
+    }
+    return out - buf;
+} // formatAccesses
+
+void Trace::printState(std::ostream& os, const t_record& record)
+{
+    char buf[formatSize];
+    os.write(buf, formatState(buf, record));
+} // printState
+
+void Trace::printAccesses(std::ostream& os, const t_record& record)
+{
+    char buf[formatSize];
+    os.write(buf, formatAccesses(buf, record));
+} // printAccesses
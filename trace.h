@@ -0,0 +1,128 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// A compact binary execution trace.
+//
+// There is one fixed-size record for each instruction executed, holding the
+// CPU state before the instruction, and the memory accesses done by it.
+// The records are kept in a ring buffer, so only the most recent ones are
+// available. The buffer can be saved to a file, and decoded later (e.g. by
+// the tracedump tool) into the same text as Cpu65C02::show() prints.
+//
+// For a complete trace, a sink (e.g. a TraceWriter, tracestream.h) is told
+// each time a block of blockRecords records has been filled, and takes them
+// from the buffer before they are overwritten.
+class TraceSink;
+
+class Trace
+{
+    public:
+        // The most memory accesses done by any instruction (BRK).
+        static const uint8_t maxAccesses = 5;
+
+        typedef struct {
+            uint16_t pc;
+            uint8_t  bytes[3];    // Opcode followed by the next two bytes.
+            uint8_t  areg;
+            uint8_t  xreg;
+            uint8_t  yreg;
+            uint8_t  sp;
+            uint8_t  flags;
+            uint8_t  accesses;    // Number of memory accesses.
+            uint8_t  writes;      // Bit n is set if access n is a write.
+            uint16_t addr[maxAccesses];
+            uint8_t  value[maxAccesses];
+        } t_record;
+
+        // Records are handed to a sink in blocks of this many. Block n holds
+        // instructions n*blockRecords up to (n+1)*blockRecords.
+        static const uint32_t blockRecords = 4096;
+
+        // The size (number of records) is rounded up to a power of two.
+        Trace(size_t size);
+
+        // Called by the CPU before each instruction.
+        void instruction(uint16_t pc, const uint8_t bytes[3], uint8_t areg,
+                uint8_t xreg, uint8_t yreg, uint8_t sp, uint8_t flags) {
+            if ((m_count & (blockRecords-1)) == 0 && m_sink && m_count)
+                blockDone();
+            m_current = &m_records[m_count & m_mask];
+            m_count += 1;
+            m_current->pc = pc;
+            m_current->bytes[0] = bytes[0];
+            m_current->bytes[1] = bytes[1];
+            m_current->bytes[2] = bytes[2];
+            m_current->areg  = areg;
+            m_current->xreg  = xreg;
+            m_current->yreg  = yreg;
+            m_current->sp    = sp;
+            m_current->flags = flags;
+            m_current->accesses = 0;
+            m_current->writes   = 0;
+        }
+
+        // Called by the memory for each access made by the instruction.
+        void access(uint16_t addr, uint8_t value, bool write) {
+            uint8_t n = m_current->accesses;
+            if (n < maxAccesses) {
+                m_current->addr[n]  = addr;
+                m_current->value[n] = value;
+                m_current->writes  |= write << n;
+                m_current->accesses = n+1;
+            }
+        }
+
+        uint64_t count() const {return m_count;}   // Instructions recorded so far.
+        size_t   size() const {return m_records.size();}
+
+        // The record of instruction n, if it is still in the buffer.
+        const t_record& record(uint64_t n) const {return m_records[n & m_mask];}
+
+        // Null to stop handing out blocks.
+        void setSink(TraceSink* sink) {m_sink = sink;}
+
+        // Write the records in the buffer to a file, oldest first.
+        bool save(const std::string& fileName) const;
+
+        // Read a file written by save(). first is the instruction number of
+        // the first record.
+        static bool load(const std::string& fileName, std::vector<t_record>& records, uint64_t& first);
+
+        // The line printed by Cpu65C02::show(), without the newline.
+        static void printState(std::ostream& os, const t_record& record);
+
+        // One line for each memory access.
+        static void printAccesses(std::ostream& os, const t_record& record);
+
+        // The same into buf, which needs room for formatSize characters.
+        // Returns the length. Nothing is allocated.
+        static const size_t formatSize = 384;
+        static size_t formatState(char* buf, const t_record& record);
+        static size_t formatAccesses(char* buf, const t_record& record);
+
+    private:
+        std::vector<t_record> m_records;
+        uint64_t  m_mask;
+        uint64_t  m_count;
+        t_record  m_scratch;    // Catches accesses before the first instruction.
+        t_record* m_current;
+        TraceSink* m_sink;
+
+        void blockDone();
+}; // end of class Trace
+
+// Takes complete blocks of records from a Trace.
+class TraceSink
+{
+    public:
+        virtual ~TraceSink() {}
+
+        // Called by the CPU thread when block n is complete, i.e. before the
+        // first instruction of the next one. It must not wait for anything.
+        virtual void blockDone(uint64_t n) = 0;
+}; // end of class TraceSink
+
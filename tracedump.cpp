@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include "trace.h"
+#include "tracestream.h"
+
+// The text is put together in a buffer, which is written out whenever it
+// is nearly full.
+class TextOutput
+{
+    public:
+        TextOutput() : m_buffer(1 << 20), m_out(m_buffer.data()),
+            m_end(m_buffer.data() + m_buffer.size() - 2*Trace::formatSize) {}
+
+        void add(const Trace::t_record& record) {
+            m_out += Trace::formatState(m_out, record);
+            *m_out++ = '\n';
+            m_out += Trace::formatAccesses(m_out, record);
+            if (m_out > m_end)
+                flush();
+        }
+
+        void flush() {
+            std::cout.write(m_buffer.data(), m_out - m_buffer.data());
+            m_out = m_buffer.data();
+        }
+
+    private:
+        std::vector<char> m_buffer;
+        char* m_out;
+        char* m_end;
+}; // end of class TextOutput
+
+// A stream written by TraceWriter. Only the blocks needed are read.
+static bool dumpStream(const std::string& fileName, uint64_t from, uint64_t to)
+{
+    TraceReader reader;
+    if (!reader.open(fileName))
+        return false;
+
+    size_t block = reader.find(from);
+    if (block == reader.blocks()) {
+        std::cerr << "No instructions from " << from << " on" << std::endl;
+        return true;
+    }
+    uint64_t expected = std::max(from, reader.first(block));
+    std::cerr << "Instructions " << expected << " to " << std::min(to, reader.first(reader.blocks() - 1) +
+            reader.count(reader.blocks() - 1)) << std::endl;
+
+    TextOutput output;
+    std::vector<Trace::t_record> records;
+    for (; block < reader.blocks() && reader.first(block) < to; ++block)
+    {
+        if (!reader.read(block, records)) {
+            std::cerr << "Block " << block << " is corrupt" << std::endl;
+            return false;
+        }
+        uint64_t first = reader.first(block);
+        if (first > expected)
+            std::cerr << "Instructions " << expected << " to " << first << " were dropped" << std::endl;
+
+        for (uint64_t i = std::max(from, first); i < std::min(to, first + records.size()); ++i)
+            output.add(records[i - first]);
+        expected = first + records.size();
+    }
+    output.flush();
+    return true;
+} // dumpStream
+
+// Decode a binary trace written by cpu65c02 into the text format: either
+// the last instructions (trace.bin), or a complete stream ("-stream").
+// Optionally only count instructions, starting at instruction first.
+int main(int argc, char* argv[])
+{
+    std::string fileName = (argc > 1) ? argv[1] : "trace.bin";
+    uint64_t from = (argc > 2) ? strtoull(argv[2], 0, 10) : 0;
+    uint64_t to   = (argc > 3) ? from + strtoull(argv[3], 0, 10) : UINT64_MAX;
+
+    std::vector<Trace::t_record> records;
+    uint64_t first;
+    if (!Trace::load(fileName, records, first))
+    {
+        if (dumpStream(fileName, from, to))
+            return std::cout.good() ? 0 : 1;
+        std::cerr << "Could not read trace from " << fileName << std::endl;
+        return 1;
+    }
+
+    uint64_t begin = std::max(from, first);
+    uint64_t end   = std::min(to, first + records.size());
+    std::cerr << "Instructions " << begin << " to " << end << std::endl;
+    TextOutput output;
+    for (uint64_t i = begin; i < end; ++i)
+        output.add(records[i - first]);
+    output.flush();
+    return std::cout.good() ? 0 : 1;
+} // main
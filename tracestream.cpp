@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <cstring>
+#include "tracestream.h"
+#include "disas.h"
+
+// The file starts with this header, followed by the blocks, each with a
+// t_blockHeader. Everything is stored in host byte order.
+typedef struct {
+    char     magic[4];      // "T65S"
+    uint32_t version;
+    uint32_t blockRecords;  // Most records in a block.
+    uint32_t reserved;
+} t_streamHeader;
+
+typedef struct {
+    uint32_t size;          // Bytes of compressed records that follow.
+    uint32_t count;         // Number of records.
+    uint64_t first;         // Instruction number of the first record.
+} t_blockHeader;
+
+static const uint32_t streamVersion = 1;
+
+// The first byte of a record.
+enum {
+    CHANGED_PC       = 0x01,    // Varint of the difference from the expected PC.
+    CHANGED_BYTES    = 0x02,    // The three instruction bytes.
+    CHANGED_AREG     = 0x04,
+    CHANGED_XREG     = 0x08,
+    CHANGED_YREG     = 0x10,
+    CHANGED_SP       = 0x20,
+    CHANGED_FLAGS    = 0x40,
+    CHANGED_ACCESSES = 0x80     // Count and writes, then varints of the address differences.
+};
+
+// The most bytes a record takes.
+static const size_t maxRecordBytes = 1 + 3 + 3 + 5 + 1 + 3*Trace::maxAccesses + Trace::maxAccesses;
+
+static uint8_t* putVarint(uint8_t* out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    *out++ = value;
+    return out;
+} // putVarint
+
+// Small differences either way give small numbers.
+static uint32_t zigzag(uint16_t difference)
+{
+    int16_t d = difference;
+    return (uint16_t) ((d << 1) ^ (d >> 15));
+}
+
+static uint16_t unzigzag(uint32_t value)
+{
+    return (uint16_t) ((value >> 1) ^ -(value & 1));
+}
+
+// Reads the compressed data, without going past its end.
+class Input
+{
+    public:
+        Input(const uint8_t* data, size_t size) : m_data(data), m_end(data + size) {}
+
+        bool get(uint8_t& value) {
+            if (m_data == m_end)
+                return false;
+            value = *m_data++;
+            return true;
+        }
+
+        bool getVarint(uint32_t& value) {
+            value = 0;
+            for (unsigned shift = 0; shift < 32; shift += 7)
+            {
+                uint8_t byte;
+                if (!get(byte))
+                    return false;
+                value |= (uint32_t) (byte & 0x7F) << shift;
+                if (!(byte & 0x80))
+                    return true;
+            }
+            return false;
+        }
+
+    private:
+        const uint8_t* m_data;
+        const uint8_t* m_end;
+}; // end of class Input
+
+TraceCodec::TraceCodec() : m_seen(65536), m_stamp(0)
+{
+    for (unsigned opcode = 0; opcode < 256; ++opcode)
+        m_length[opcode] = instructionLength(opcode);
+    memset(m_seen.data(), 0, m_seen.size() * sizeof(t_seen));
+} // TraceCodec
+
+TraceCodec::t_seen& TraceCodec::seen(uint16_t pc)
+{
+    t_seen& entry = m_seen[pc];
+    if (entry.stamp != m_stamp) {
+        memset(&entry, 0, sizeof(entry));
+        entry.stamp = m_stamp;
+    }
+    return entry;
+} // seen
+
+void TraceCodec::encode(const Trace::t_record* records, size_t count, std::vector<uint8_t>& buffer)
+{
+    size_t size = buffer.size();
+    buffer.resize(size + count * maxRecordBytes);
+    uint8_t* out = buffer.data() + size;
+
+    m_stamp += 1;
+    Trace::t_record previous = {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Trace::t_record& record = records[i];
+        t_seen& entry = seen(record.pc);
+        uint16_t expected = previous.pc + m_length[previous.bytes[0]];
+
+        bool sameAccesses = entry.accesses == record.accesses && entry.writes == record.writes;
+        for (uint8_t n = 0; sameAccesses && n < record.accesses; ++n)
+            sameAccesses = entry.addr[n] == record.addr[n];
+
+        uint8_t changed = (record.pc != expected) * CHANGED_PC |
+                          (memcmp(record.bytes, entry.bytes, 3) != 0) * CHANGED_BYTES |
+                          (record.areg != previous.areg) * CHANGED_AREG |
+                          (record.xreg != previous.xreg) * CHANGED_XREG |
+                          (record.yreg != previous.yreg) * CHANGED_YREG |
+                          (record.sp != previous.sp) * CHANGED_SP |
+                          (record.flags != previous.flags) * CHANGED_FLAGS |
+                          !sameAccesses * CHANGED_ACCESSES;
+
+        *out++ = changed;
+        if (changed & CHANGED_PC)
+            out = putVarint(out, zigzag(record.pc - expected));
+        if (changed & CHANGED_BYTES) {
+            memcpy(out, record.bytes, 3);
+            out += 3;
+        }
+
+        // Which registers change is hard to predict, so there are no branches.
+        *out = record.areg;
+        out += (changed & CHANGED_AREG) != 0;
+        *out = record.xreg;
+        out += (changed & CHANGED_XREG) != 0;
+        *out = record.yreg;
+        out += (changed & CHANGED_YREG) != 0;
+        *out = record.sp;
+        out += (changed & CHANGED_SP) != 0;
+        *out = record.flags;
+        out += (changed & CHANGED_FLAGS) != 0;
+        if (changed & CHANGED_ACCESSES) {
+            *out++ = record.accesses | (record.writes << 3);
+            for (uint8_t n = 0; n < record.accesses; ++n)
+                out = putVarint(out, zigzag(record.addr[n] - entry.addr[n]));
+        }
+        memcpy(out, record.value, record.accesses);
+        out += record.accesses;
+
+        memcpy(entry.bytes, record.bytes, 3);
+        entry.accesses = record.accesses;
+        entry.writes   = record.writes;
+        memcpy(entry.addr, record.addr, record.accesses * sizeof(uint16_t));
+        previous = record;
+    }
+    buffer.resize(out - buffer.data());
+} // encode
+
+bool TraceCodec::decode(const uint8_t* data, size_t size, size_t count, std::vector<Trace::t_record>& records)
+{
+    m_stamp += 1;
+    records.assign(count, Trace::t_record());
+    Input in(data, size);
+    Trace::t_record previous = {};
+    for (size_t i = 0; i < count; ++i)
+    {
+        Trace::t_record& record = records[i];
+        uint8_t changed;
+        if (!in.get(changed))
+            return false;
+
+        record = previous;
+        record.pc = previous.pc + m_length[previous.bytes[0]];
+        uint32_t value;
+        if (changed & CHANGED_PC) {
+            if (!in.getVarint(value))
+                return false;
+            record.pc += unzigzag(value);
+        }
+
+        t_seen& entry = seen(record.pc);
+        memcpy(record.bytes, entry.bytes, 3);
+        record.accesses = entry.accesses;
+        record.writes   = entry.writes;
+        memset(record.addr, 0, sizeof(record.addr));
+        memset(record.value, 0, sizeof(record.value));
+        memcpy(record.addr, entry.addr, entry.accesses * sizeof(uint16_t));
+
+        bool ok = true;
+        if (changed & CHANGED_BYTES)
+            ok = in.get(record.bytes[0]) && in.get(record.bytes[1]) && in.get(record.bytes[2]);
+        if (changed & CHANGED_AREG)
+            ok = ok && in.get(record.areg);
+        if (changed & CHANGED_XREG)
+            ok = ok && in.get(record.xreg);
+        if (changed & CHANGED_YREG)
+            ok = ok && in.get(record.yreg);
+        if (changed & CHANGED_SP)
+            ok = ok && in.get(record.sp);
+        if (changed & CHANGED_FLAGS)
+            ok = ok && in.get(record.flags);
+        if (ok && (changed & CHANGED_ACCESSES)) {
+            uint8_t byte = 0;
+            ok = in.get(byte) && (byte & 7) <= Trace::maxAccesses;
+            record.accesses = byte & 7;
+            record.writes   = byte >> 3;
+            for (uint8_t n = 0; ok && n < record.accesses; ++n)
+            {
+                ok = in.getVarint(value);
+                record.addr[n] = entry.addr[n] + unzigzag(value);
+            }
+        }
+        for (uint8_t n = 0; ok && n < record.accesses && n < Trace::maxAccesses; ++n)
+            ok = in.get(record.value[n]);
+        if (!ok)
+            return false;
+
+        memcpy(entry.bytes, record.bytes, 3);
+        entry.accesses = record.accesses;
+        entry.writes   = record.writes;
+        memcpy(entry.addr, record.addr, record.accesses * sizeof(uint16_t));
+        previous = record;
+    }
+    return true;
+} // decode
+
+TraceWriter::TraceWriter(Trace& trace, const std::string& fileName) : m_trace(trace), m_file(0),
+    m_start(trace.count()), m_error(false), m_head(0), m_done(0), m_tail(0), m_stop(false),
+    m_sleeping(false), m_dropped(0), m_overwritten(0), m_records(0), m_bytes(0)
+{
+    size_t ringBlocks = trace.size() / Trace::blockRecords;
+    if (ringBlocks < 4)
+        return;
+    m_file = fopen(fileName.c_str(), "wb");
+    if (!m_file)
+        return;
+
+    t_streamHeader header = {};
+    memcpy(header.magic, "T65S", 4);
+    header.version      = streamVersion;
+    header.blockRecords = Trace::blockRecords;
+    m_error = fwrite(&header, sizeof(header), 1, m_file) != 1;
+    m_bytes = sizeof(header);
+
+    m_queue.resize(ringBlocks - 2);
+    m_block.resize(Trace::blockRecords);
+    m_thread = std::thread(&TraceWriter::run, this);
+    m_trace.setSink(this);
+} // TraceWriter
+
+TraceWriter::~TraceWriter()
+{
+    finish();
+} // ~TraceWriter
+
+void TraceWriter::blockDone(uint64_t n)
+{
+    // Published before any record of the next block is written, for the
+    // writer to check its copies against.
+    m_done.store(n, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == m_queue.size()) {
+        m_dropped += 1;
+        return;
+    }
+    m_queue[head % m_queue.size()] = n;
+    m_head.store(head + 1);
+    if (m_sleeping.load())
+        wake();
+} // blockDone
+
+// Taking the mutex makes sure the writer is either still checking the
+// queue, or already waiting, so that the notification is not lost.
+void TraceWriter::wake()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wake.notify_one();
+} // wake
+
+// The writer thread. A block is only taken off the queue once it has been
+// copied out of the ring, and it is dropped if the CPU thread had got to
+// the same place in the ring meanwhile.
+void TraceWriter::run()
+{
+    size_t ringBlocks = m_trace.size() / Trace::blockRecords;
+    while (true)
+    {
+        uint64_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_head.load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleeping.store(true);
+            m_wake.wait(lock, [this, tail] {return m_stop.load() || m_head.load() != tail;});
+            m_sleeping.store(false);
+            if (m_head.load(std::memory_order_acquire) == tail)
+                break;
+            continue;
+        }
+
+        uint64_t n = m_queue[tail % m_queue.size()];
+        uint64_t first = std::max(n * Trace::blockRecords, m_start);
+        uint64_t last  = (n + 1) * Trace::blockRecords;
+        for (uint64_t i = first; i < last; ++i)
+            m_block[i - first] = m_trace.record(i);
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        // The CPU thread writes block m_done + 1 at most, and block n + ringBlocks
+        // takes the place of block n.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_done.load(std::memory_order_relaxed) + 1 >= n + ringBlocks)
+            m_overwritten += 1;
+        else
+            write(first, last);
+    }
+} // run
+
+// Compress the records of instructions first to last, already in m_block.
+void TraceWriter::write(uint64_t first, uint64_t last)
+{
+    m_buffer.resize(sizeof(t_blockHeader));
+    m_codec.encode(m_block.data(), last - first, m_buffer);
+
+    t_blockHeader header;
+    header.size  = m_buffer.size() - sizeof(header);
+    header.count = last - first;
+    header.first = first;
+    memcpy(m_buffer.data(), &header, sizeof(header));
+
+    if (fwrite(m_buffer.data(), m_buffer.size(), 1, m_file) != 1)
+        m_error = true;
+    m_records += header.count;
+    m_bytes   += m_buffer.size();
+} // write
+
+bool TraceWriter::finish()
+{
+    if (!m_file)
+        return false;
+
+    m_trace.setSink(0);
+    m_stop.store(true);
+    wake();
+    m_thread.join();
+
+    // The last block, which may not be full.
+    uint64_t count = m_trace.count();
+    if (count > m_start) {
+        uint64_t first = std::max((count - 1) / Trace::blockRecords * Trace::blockRecords, m_start);
+        for (uint64_t i = first; i < count; ++i)
+            m_block[i - first] = m_trace.record(i);
+        write(first, count);
+    }
+
+    if (fclose(m_file) != 0)
+        m_error = true;
+    m_file = 0;
+    return !m_error;
+} // finish
+
+TraceReader::~TraceReader()
+{
+    if (m_file)
+        fclose(m_file);
+} // ~TraceReader
+
+bool TraceReader::open(const std::string& fileName)
+{
+    if (m_file)
+        fclose(m_file);
+    m_index.clear();
+    m_file = fopen(fileName.c_str(), "rb");
+    if (!m_file)
+        return false;
+
+    t_streamHeader header;
+    if (fread(&header, sizeof(header), 1, m_file) != 1 || memcmp(header.magic, "T65S", 4) ||
+        header.version != streamVersion)
+        return false;
+
+    fseek(m_file, 0, SEEK_END);
+    uint64_t fileSize = ftell(m_file);
+    uint64_t offset = sizeof(header);
+    t_blockHeader block;
+    while (fseek(m_file, offset, SEEK_SET) == 0 && fread(&block, sizeof(block), 1, m_file) == 1)
+    {
+        offset += sizeof(block);
+        if (offset + block.size > fileSize)
+            break;
+        t_entry entry = {offset, block.first, block.count, block.size};
+        m_index.push_back(entry);
+        offset += block.size;
+    }
+    return true;
+} // open
+
+size_t TraceReader::find(uint64_t n) const
+{
+    size_t low = 0, high = m_index.size();
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (m_index[middle].first + m_index[middle].count <= n)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+} // find
+
+bool TraceReader::read(size_t block, std::vector<Trace::t_record>& records)
+{
+    const t_entry& entry = m_index[block];
+    m_buffer.resize(entry.size);
+    if (fseek(m_file, entry.offset, SEEK_SET) != 0 || fread(m_buffer.data(), 1, entry.size, m_file) != entry.size)
+        return false;
+    return m_codec.decode(m_buffer.data(), entry.size, entry.count, records);
+} // read
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "trace.h"
+
+// A complete execution trace, streamed to a file while the program runs.
+//
+// The Trace ring buffer is cut into blocks of Trace::blockRecords records.
+// Each time one is full, its number is put into a lock-free queue with a
+// single producer (the CPU thread) and a single consumer (the writer
+// thread). The writer copies the block out of the ring, compresses it and
+// writes it to the file, so the CPU thread never waits for the disk.
+//
+// If the writer falls so far behind that the queue is full, the block is
+// dropped rather than stopping the CPU, and it is missing from the file.
+// The CPU keeps going meanwhile, so a block still queued may have been
+// overwritten by the time the writer copies it. The writer checks which
+// block the CPU had got to after copying, and drops the copy if so.
+//
+// The writer sleeps while the queue is empty, and the CPU thread only wakes
+// it when it is sleeping.
+//
+// The records are compressed with TraceCodec. Each block is compressed on
+// its own, and has a header giving its size and first instruction, so a
+// reader can find any block by reading only the headers.
+
+// Delta and varint coding of the records of one block.
+//
+// Each record starts with a byte telling what differs from what is
+// expected: a PC other than that of the next instruction, instruction bytes
+// or memory accesses other than at the last visit to the same PC, and each
+// changed register. Only those are stored, followed by the values of the
+// memory accesses. A record of a loop is then mostly two or three bytes.
+class TraceCodec
+{
+    public:
+        TraceCodec();
+
+        // Appends the block to out.
+        void encode(const Trace::t_record* records, size_t count, std::vector<uint8_t>& out);
+
+        // Decodes count records from data. Returns false if it is corrupt.
+        bool decode(const uint8_t* data, size_t size, size_t count, std::vector<Trace::t_record>& records);
+
+    private:
+        // What was seen at an address the last time it was executed. Only
+        // entries stamped with the current block are used, so that every
+        // block can be decoded without the ones before it.
+        typedef struct {
+            uint32_t stamp;
+            uint8_t  bytes[3];
+            uint8_t  accesses;
+            uint8_t  writes;
+            uint16_t addr[Trace::maxAccesses];
+        } t_seen;
+
+        std::vector<t_seen> m_seen;     // Indexed by PC.
+        uint32_t m_stamp;
+        uint8_t  m_length[256];         // Of each instruction.
+
+        t_seen& seen(uint16_t pc);
+}; // end of class TraceCodec
+
+class TraceWriter : public TraceSink
+{
+    public:
+        // Writes everything recorded from now on to the file. The trace
+        // needs room for at least four blocks.
+        TraceWriter(Trace& trace, const std::string& fileName);
+        ~TraceWriter();     // Calls finish().
+        TraceWriter(const TraceWriter&) = delete;
+        TraceWriter& operator=(const TraceWriter&) = delete;
+
+        bool good() const {return m_file != 0 && !m_error;}
+
+        // Waits for the queued blocks to be written, then writes the records
+        // since the last full block and closes the file. Call it when the
+        // CPU has stopped. Returns false if anything could not be written.
+        bool finish();
+
+        virtual void blockDone(uint64_t n);
+
+        // Statistics, valid after finish().
+        uint64_t records() const {return m_records;}    // Written to the file.
+        uint64_t bytes() const   {return m_bytes;}
+        uint64_t dropped() const {return m_dropped + m_overwritten;}   // Blocks left out.
+
+    private:
+        Trace&   m_trace;
+        FILE*    m_file;
+        uint64_t m_start;       // First instruction to write.
+        bool     m_error;
+
+        // The queue of full blocks.
+        std::vector<uint64_t> m_queue;
+        alignas(64) std::atomic<uint64_t> m_head;   // Only changed by the CPU thread.
+        std::atomic<uint64_t> m_done;               // The last block completed.
+        alignas(64) std::atomic<uint64_t> m_tail;   // Only changed by the writer thread.
+        alignas(64) std::atomic<bool> m_stop;
+        std::atomic<bool> m_sleeping;               // The writer waits for m_wake.
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        uint64_t m_dropped;     // By the CPU thread, as the queue was full.
+        uint64_t m_overwritten; // By the writer thread.
+
+        std::thread m_thread;
+        TraceCodec  m_codec;
+        std::vector<Trace::t_record> m_block;
+        std::vector<uint8_t> m_buffer;
+        uint64_t m_records;
+        uint64_t m_bytes;
+
+        void run();
+        void wake();
+        void write(uint64_t first, uint64_t last);
+}; // end of class TraceWriter
+
+// Reads a file written by TraceWriter.
+class TraceReader
+{
+    public:
+        TraceReader() : m_file(0) {}
+        ~TraceReader();
+        TraceReader(const TraceReader&) = delete;
+        TraceReader& operator=(const TraceReader&) = delete;
+
+        // Reads the headers of all blocks. A block cut short, e.g. because
+        // the emulator was killed, is left out.
+        bool open(const std::string& fileName);
+
+        size_t   blocks() const {return m_index.size();}
+        uint64_t first(size_t block) const {return m_index[block].first;}
+        uint32_t count(size_t block) const {return m_index[block].count;}
+
+        // The block holding instruction n, or else the first one after it.
+        // blocks() if there is none.
+        size_t find(uint64_t n) const;
+
+        bool read(size_t block, std::vector<Trace::t_record>& records);
+
+    private:
+        typedef struct {
+            uint64_t offset;    // Of the compressed records.
+            uint64_t first;
+            uint32_t count;
+            uint32_t size;
+        } t_entry;
+
+        FILE* m_file;
+        std::vector<t_entry> m_index;
+        std::vector<uint8_t> m_buffer;
+        TraceCodec m_codec;
+}; // end of class TraceReader
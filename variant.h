@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include "decimal.h"
+#include "decode.h"
+
+// The CPU variants, as policies for Cpu65C02::execute(). Each one gives the
+// decoding of every opcode as a constexpr function, and constants for the
+// differences in behaviour. The handlers are specialized for the variant
+// as well as the opcode, so each variant gets an interpreter of its own,
+// and nothing is decided while running.
+
+// How a variant decodes one opcode.
+typedef struct {
+    addrMode_t    addrMode;
+    instruction_t instruction;
+    uint8_t       cycles;
+} t_opcode;
+
+// The WDC 65C02, with WAI and STP. The tables in decode.h are its own.
+struct Wdc65C02
+{
+    static constexpr t_opcode opcode(uint8_t op) {
+        return {addrModes[op], instructions[op], cycles[op]};
+    }
+
+    static constexpr bool indirectPageWrap = false;     // JMP ($xxFF) reads the high byte from $xx00.
+    static constexpr bool shiftPagePenalty = true;      // See pagePenalty().
+    static constexpr bool interruptClearsDecimal = true;
+    static constexpr const t_decimalTables& decimal = decimalTables;
+    static constexpr uint8_t decimalCycles = 1;         // Extra for ADC and SBC in decimal mode.
+}; // end of struct Wdc65C02
+
+// The Rockwell 65C02 has the bit instructions (BBR, BBS, RMB and SMB) too,
+// but where WDC put WAI and STP it has one cycle NOPs.
+struct Rockwell65C02 : public Wdc65C02
+{
+    static constexpr t_opcode opcode(uint8_t op) {
+        return (op == 0xCB || op == 0xDB) ? t_opcode{AM_NONE, I_NOP, 1} : Wdc65C02::opcode(op);
+    }
+}; // end of struct Rockwell65C02
+
+// The NMOS 6502 has none of the instructions and addressing modes that the
+// 65C02 added. Its undocumented opcodes are not emulated, so they stop
+// the CPU as illegal.
+struct Nmos6502
+{
+    static constexpr bool documented(uint8_t op) {
+        return op == 0xEA || (instructions[op] <= I_BRK && instructions[op] != I_NOP && addrModes[op] < AM_RES &&
+                              op != 0x34 && op != 0x3C && op != 0x89);   // BIT zp,X, abs,X and #imm
+    }
+
+    static constexpr t_opcode opcode(uint8_t op) {
+        return !documented(op) ? t_opcode{AM_RES, I_RES, 1} :
+               (op == 0x6C)    ? t_opcode{AM_IND, I_JMP, 5} :
+               (op == 0x1E || op == 0x3E || op == 0x5E || op == 0x7E) ?
+                                 t_opcode{addrModes[op], instructions[op], 7} :
+                                 Wdc65C02::opcode(op);
+    }
+
+    static constexpr bool indirectPageWrap = true;
+    static constexpr bool shiftPagePenalty = false;     // They always take 7 cycles instead.
+    static constexpr bool interruptClearsDecimal = false;
+    static constexpr const t_decimalTables& decimal = nmosDecimalTables;
+    static constexpr uint8_t decimalCycles = 0;
+}; // end of struct Nmos6502